@@ -0,0 +1,250 @@
+#include "AssetLoader.h"
+#include "Profiler.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+
+#define LOG(argument) std::cout << argument << '\n'
+
+/**
+ Where stb's working memory comes from while a worker decodes into staging memory. Nothing is
+ freed until reset() after each image, which keeps one block big enough for everything that
+ image needed, so after the first few images a decode doesn't allocate at all.
+ */
+class ScratchArena
+{
+public:
+    static void* allocate(void* user, size_t size);  // stbi_allocator's allocate, user is the arena
+    void reset();
+
+private:
+    static constexpr size_t ALIGNMENT = 16;
+    static constexpr size_t MINIMUM_BLOCK = 1 << 20;
+
+    struct Block
+    {
+        std::unique_ptr<unsigned char[]> memory;
+        size_t size = 0;
+    };
+
+    std::vector<Block> m_blocks;
+    size_t m_used = 0;  // into the last block
+};
+
+AssetLoader::AssetLoader(unsigned int thread_count)
+{
+    for (unsigned int i = 0; i < std::max(thread_count, 1u); i++)
+    {
+        m_threads.emplace_back(&AssetLoader::worker_loop, this);
+    }
+}
+
+AssetLoader::~AssetLoader()
+{
+    shutdown();
+}
+
+void AssetLoader::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (std::thread& thread : m_threads) thread.join();
+    m_threads.clear();
+
+    // anything nobody came back for, slots included
+    for (DecodedImage& image : m_finished)
+    {
+        if (image.staging_slot >= 0) m_release_staging(image.staging_slot);
+        free_image(image);
+    }
+    m_finished.clear();
+}
+
+void AssetLoader::request(int id, const std::string& path, int mip_levels, int max_size)
+{
+    Job job;
+    job.image.id = id;
+    job.image.path = path;
+    job.image.mip_levels = mip_levels;
+    job.max_size = max_size;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(job);
+        m_outstanding++;
+    }
+    m_wake.notify_one();
+}
+
+std::vector<DecodedImage> AssetLoader::take_finished()
+{
+    std::vector<DecodedImage> finished;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    finished.swap(m_finished);
+    m_outstanding -= (unsigned int)finished.size();
+    return finished;
+}
+
+bool AssetLoader::idle()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_outstanding == 0;
+}
+
+void AssetLoader::free_image(DecodedImage& image)
+{
+    if (image.staging_slot < 0) stbi_image_free(image.pixels);
+    image.pixels = nullptr;
+}
+
+void* ScratchArena::allocate(void* user, size_t size)
+{
+    ScratchArena& arena = *(ScratchArena*)user;
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (arena.m_blocks.empty() || arena.m_used + size > arena.m_blocks.back().size)
+    {
+        Block block;
+        block.size = std::max(size, arena.m_blocks.empty() ? MINIMUM_BLOCK : arena.m_blocks.back().size * 2);
+        block.memory.reset(new (std::nothrow) unsigned char[block.size]);
+        if (block.memory == nullptr) return nullptr;
+        arena.m_blocks.push_back(std::move(block));
+        arena.m_used = 0;
+    }
+    void* memory = arena.m_blocks.back().memory.get() + arena.m_used;
+    arena.m_used += size;
+    return memory;
+}
+
+void ScratchArena::reset()
+{
+    // one block big enough for all of it next time round
+    if (m_blocks.size() > 1)
+    {
+        size_t total = 0;
+        for (const Block& block : m_blocks) total += block.size;
+        m_blocks.clear();
+
+        Block block;
+        block.size = total;
+        block.memory.reset(new (std::nothrow) unsigned char[total]);
+        if (block.memory != nullptr) m_blocks.push_back(std::move(block));
+    }
+    m_used = 0;
+}
+
+// Averages each 2x2 block into one pixel, in place
+static void halve_image(unsigned char* image, int& width, int& height)
+{
+    int half_width = width > 1 ? width / 2 : 1, half_height = height > 1 ? height / 2 : 1;
+    for (int y = 0; y < half_height; y++)
+    {
+        const unsigned char* row_0 = image + (size_t)std::min(y * 2, height - 1) * width * 4;
+        const unsigned char* row_1 = image + (size_t)std::min(y * 2 + 1, height - 1) * width * 4;
+        for (int x = 0; x < half_width; x++)
+        {
+            int x_0 = std::min(x * 2, width - 1) * 4, x_1 = std::min(x * 2 + 1, width - 1) * 4;
+            for (int c = 0; c < 4; c++)
+            {
+                image[((size_t)y * half_width + x) * 4 + c] = (unsigned char)((row_0[x_0 + c] + row_0[x_1 + c] + row_1[x_0 + c] + row_1[x_1 + c] + 2) / 4);
+            }
+        }
+    }
+    width = half_width;
+    height = half_height;
+}
+
+void AssetLoader::decode(Job& job, ScratchArena& scratch)
+{
+    DecodedImage& image = job.image;
+    int number_of_components;
+    if (!stbi_info(image.path.c_str(), &image.width, &image.height, &number_of_components))
+    {
+        LOG("Unable to load image " << image.path << ": " << stbi_failure_reason() << ". Make sure the path is correct.");
+        return;
+    }
+
+    // Images that fit go straight into staging memory, with stb's working memory coming out
+    // of the arena, so nothing on the way allocates once the arena has grown to size
+    bool fits = job.max_size <= 0 || image.mip_levels == 0 || (image.width <= job.max_size && image.height <= job.max_size);
+    size_t bytes = (size_t)image.width * image.height * 4;
+    unsigned char* staged = fits && m_staging ? m_staging(bytes, image.staging_slot) : nullptr;
+    if (staged != nullptr)
+    {
+        stbi_allocator allocator = { &ScratchArena::allocate, nullptr, &scratch };
+        if (stbi_load_into(image.path.c_str(), staged, bytes, image.width * 4, &image.width, &image.height, &number_of_components, STBI_rgb_alpha, &allocator))
+        {
+            image.pixels = staged;
+        }
+        else
+        {
+            // whatever made it into the slot is garbage, and nobody else will know to give it back
+            LOG("Unable to load image " << image.path << ": " << stbi_failure_reason());
+            m_release_staging(image.staging_slot);
+            image.staging_slot = -1;
+        }
+        return;
+    }
+
+    image.pixels = stbi_load(image.path.c_str(), &image.width, &image.height, &number_of_components, STBI_rgb_alpha);
+    if (image.pixels == NULL)
+    {
+        LOG("Unable to load image " << image.path << ": " << stbi_failure_reason());
+        return;
+    }
+
+    // Nothing gets drawn bigger than max_size, so levels above that would never be
+    // sampled. Drop them before they take up any GPU memory.
+    while (job.max_size > 0 && (image.width > job.max_size || image.height > job.max_size) && image.mip_levels > 0)
+    {
+        halve_image(image.pixels, image.width, image.height);
+        image.mip_levels--;
+    }
+
+    bytes = (size_t)image.width * image.height * 4;
+    staged = m_staging ? m_staging(bytes, image.staging_slot) : nullptr;
+    if (staged != nullptr)
+    {
+        memcpy(staged, image.pixels, bytes);
+        stbi_image_free(image.pixels);
+        image.pixels = staged;
+    }
+}
+
+void AssetLoader::worker_loop()
+{
+    // GL wants rows top down, so this thread decodes with its own settings rather than whatever
+    // someone last set globally, and stb's failure reasons are per thread too
+    stbi_options options;
+    stbi_get_default_options(&options);
+    options.flip_vertically = 0;
+    stbi_set_thread_options(&options);
+
+    ScratchArena scratch;
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_stopping) return;
+            job = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        {
+            PROFILE_SCOPE("decode_image");
+            decode(job, scratch);
+            scratch.reset();
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished.push_back(job.image);
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// An image decoded to RGBA8, ready to hand to glTexImage2D. pixels is NULL if decoding failed.
+struct DecodedImage
+{
+    int id = 0;                    // whatever the caller passed to request()
+    std::string path;
+    unsigned char* pixels = nullptr;
+    int width = 0, height = 0;
+    int mip_levels = 0;            // reductions left after shrinking to max_size
+    int staging_slot = -1;         // >= 0 when pixels live in staging memory rather than stb's buffer
+};
+
+// Somewhere for a worker to put decoded pixels instead of keeping stb's buffer, mapped GL memory
+// say. Called on worker threads, returns nullptr (and leaves slot alone) to keep stb's buffer.
+// Images that need no shrinking are decoded straight into it, and the memory is only written.
+// The release function gets back slots the loader ends up not handing out, when decoding into
+// one fails or nobody calls take_finished() before shutdown().
+using StagingFunction = std::function<unsigned char*(size_t bytes, int& slot)>;
+using StagingReleaseFunction = std::function<void(int slot)>;
+
+class ScratchArena;
+
+/**
+ Decodes images on its own threads so startup doesn't wait on PNG inflation one file at a time.
+ Nothing in here touches GL: the GL thread calls take_finished() whenever it likes, uploads what
+ came back and frees the pixels with free_image(). Until then it's up to the caller to draw
+ something in the texture's place.
+ */
+class AssetLoader
+{
+public:
+    explicit AssetLoader(unsigned int thread_count);
+    ~AssetLoader();
+
+    AssetLoader(const AssetLoader&) = delete;
+    AssetLoader& operator=(const AssetLoader&) = delete;
+
+    // Queues path for decoding. Images bigger than max_size (0 for no limit) are halved on the
+    // worker until they fit, giving up one of mip_levels each time.
+    void request(int id, const std::string& path, int mip_levels, int max_size = 0);
+
+    // Stops the workers and waits for them, a decode in progress gets to finish first. Once this
+    // returns nothing writes to staging memory again. The destructor does it too.
+    void shutdown();
+
+    // Set before the first request()
+    void set_staging(StagingFunction staging, StagingReleaseFunction release)
+    {
+        m_staging = staging;
+        m_release_staging = release;
+    }
+
+    // Everything that finished decoding since the last call, in no particular order
+    std::vector<DecodedImage> take_finished();
+
+    // true once every requested image has been handed out by take_finished()
+    bool idle();
+
+    // Staged images are only forgotten here, whoever handed out the slot gets it back
+    static void free_image(DecodedImage& image);
+
+private:
+    struct Job
+    {
+        DecodedImage image;
+        int max_size;
+    };
+
+    void decode(Job& job, ScratchArena& scratch);
+    void worker_loop();
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+
+    StagingFunction m_staging;
+    StagingReleaseFunction m_release_staging;
+    std::deque<Job> m_queue;
+    std::vector<DecodedImage> m_finished;
+    unsigned int m_outstanding = 0;  // requested but not yet taken
+    bool m_stopping = false;
+};
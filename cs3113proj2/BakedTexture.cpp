@@ -0,0 +1,130 @@
+#include "BakedTexture.h"
+#include "BlockCompression.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#define LOG(argument) std::cout << argument << '\n'
+
+size_t baked_level_size(uint32_t format, uint32_t width, uint32_t height)
+{
+    return format >= BAKED_BC3 ? bc3_size(width, height) : (size_t)width * height * 4;
+}
+
+uint64_t baked_source_hash(const void* data, size_t size)
+{
+    // eight bytes a step rather than one, it's on the way to every baked load
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash ^= word;
+        hash *= 1099511628211ull;
+    }
+    for (; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool BakedTexture::open(const std::string& path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    HANDLE mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    const void* data = mapping != NULL ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    m_file = file;
+    m_mapping = mapping;
+    if (data == NULL)
+    {
+        close();
+        return false;
+    }
+    m_data = (const unsigned char*)data;
+    m_size = (size_t)size.QuadPart;
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) return false;
+
+    struct stat info;
+    void* data = fstat(file, &info) == 0 && info.st_size > 0 ? mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+    ::close(file);  // the mapping keeps the file alive on its own
+    if (data == MAP_FAILED) return false;
+    m_data = (const unsigned char*)data;
+    m_size = (size_t)info.st_size;
+#endif
+
+    // check every level lands inside the file before anyone hands a pointer to GL
+    bool valid = m_size >= sizeof(BakedHeader) && memcmp(header()->magic, BAKED_MAGIC, sizeof(BAKED_MAGIC)) == 0
+              && header()->version == BAKED_VERSION && header()->format <= BAKED_BC3_PREMULTIPLIED
+              && header()->level_count > 0 && header()->level_count <= BAKED_MAX_LEVELS;
+    for (uint32_t i = 0; valid && i < header()->level_count; i++)
+    {
+        const BakedLevel& level = header()->levels[i];
+        valid = level.size == baked_level_size(header()->format, level.width, level.height) && level.offset <= m_size && level.size <= m_size - level.offset;
+    }
+    if (!valid)
+    {
+        LOG(path << " isn't a texture this version of texture_baker wrote, rebake it");
+        close();
+        return false;
+    }
+    return true;
+}
+
+void BakedTexture::close()
+{
+#ifdef _WIN32
+    if (m_data != nullptr) UnmapViewOfFile(m_data);
+    if (m_mapping != nullptr) CloseHandle(m_mapping);
+    if (m_file != nullptr) CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    if (m_data != nullptr) munmap((void*)m_data, m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool BakedTexture::matches_source(const std::string& source_path) const
+{
+    FILE* file = fopen(source_path.c_str(), "rb");
+    if (file == NULL) return false;
+
+    // the size alone catches most edits without reading anything
+    std::vector<unsigned char> contents;
+    bool matches = fseek(file, 0, SEEK_END) == 0;
+    long size = matches ? ftell(file) : -1;
+    matches = size >= 0 && (uint64_t)size == header()->source_size && fseek(file, 0, SEEK_SET) == 0;
+    if (matches)
+    {
+        contents.resize((size_t)size);
+        matches = fread(contents.data(), 1, contents.size(), file) == contents.size()
+               && baked_source_hash(contents.data(), contents.size()) == header()->source_hash;
+    }
+    fclose(file);
+    return matches;
+}
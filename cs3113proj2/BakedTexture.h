@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ Textures as texture_baker writes them: a header, then every mip level either as raw RGBA8
+ rows, exactly what glTexImage2D wants, or as BC3 blocks for glCompressedTexImage2D (see
+ BlockCompression.h). Each level starts on a BAKED_ALIGNMENT boundary so the pointers
+ handed to GL out of the mapped file are nicely aligned too. The header remembers the size and
+ hash of the PNG it was baked from, so a bake that's fallen behind its PNG can be spotted.
+
+ Everything is little-endian, which is everything we ship on.
+ */
+constexpr char BAKED_MAGIC[4] = { 'B', 'T', 'E', 'X' };
+constexpr uint32_t BAKED_VERSION = 2;
+constexpr uint32_t BAKED_MAX_LEVELS = 16;
+constexpr uint32_t BAKED_ALIGNMENT = 256;
+
+enum BakedFormat : uint32_t
+{
+    BAKED_RGBA8 = 0,
+    BAKED_RGBA8_PREMULTIPLIED = 1,  // colour already multiplied by alpha, blend with GL_ONE
+    BAKED_BC3 = 2,
+    BAKED_BC3_PREMULTIPLIED = 3,
+};
+
+// Bytes a level of this format and size takes up in the file
+size_t baked_level_size(uint32_t format, uint32_t width, uint32_t height);
+
+// 64-bit FNV-1a over the source file, a little-endian word at a time, what BakedHeader::source_hash holds
+uint64_t baked_source_hash(const void* data, size_t size);
+
+struct BakedLevel
+{
+    uint32_t width, height;
+    uint64_t offset, size;  // bytes from the start of the file
+};
+
+struct BakedHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t level_count;
+    uint64_t source_size, source_hash;  // of the file it was baked from, byte for byte
+    BakedLevel levels[BAKED_MAX_LEVELS];
+};
+
+/**
+ A baked texture mapped straight into memory. Nothing is read or copied up front, the pages
+ come in as GL reads the levels out of it. Close it once the upload is done.
+ */
+class BakedTexture
+{
+public:
+    BakedTexture() = default;
+    ~BakedTexture() { close(); }
+
+    BakedTexture(const BakedTexture&) = delete;
+    BakedTexture& operator=(const BakedTexture&) = delete;
+
+    // false if the file is missing, not a baked texture, or from another version of the baker
+    bool open(const std::string& path);
+    void close();
+
+    // false if source_path can't be read or isn't the file this was baked from any more. Reads
+    // all of it, which is still far quicker than decoding it.
+    bool matches_source(const std::string& source_path) const;
+
+    uint32_t level_count() const { return header()->level_count; }
+    bool premultiplied() const { return (header()->format & 1) != 0; }
+    bool compressed() const { return header()->format >= BAKED_BC3; }
+    const BakedLevel& level(uint32_t index) const { return header()->levels[index]; }
+    const void* level_pixels(uint32_t index) const { return m_data + level(index).offset; }
+
+private:
+    const BakedHeader* header() const { return (const BakedHeader*)m_data; }
+
+    const unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
@@ -0,0 +1,298 @@
+#include "BlockCompression.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static uint16_t pack_565(const float colour[3])
+{
+    int red = (int)std::lround(std::min(std::max(colour[0], 0.0f), 255.0f) * 31.0f / 255.0f);
+    int green = (int)std::lround(std::min(std::max(colour[1], 0.0f), 255.0f) * 63.0f / 255.0f);
+    int blue = (int)std::lround(std::min(std::max(colour[2], 0.0f), 255.0f) * 31.0f / 255.0f);
+    return (uint16_t)((red << 11) | (green << 5) | blue);
+}
+
+// top bits copied into the bottom so 31 and 63 come out as 255
+static void unpack_565(uint16_t packed, int colour[3])
+{
+    int red = (packed >> 11) & 31, green = (packed >> 5) & 63, blue = packed & 31;
+    colour[0] = (red << 3) | (red >> 2);
+    colour[1] = (green << 2) | (green >> 4);
+    colour[2] = (blue << 3) | (blue >> 2);
+}
+
+// the four colours a block's indices pick from, in four colour mode (first endpoint larger)
+static void colour_palette(uint16_t c0, uint16_t c1, int palette[4][3])
+{
+    unpack_565(c0, palette[0]);
+    unpack_565(c1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+}
+
+static void alpha_palette(int a0, int a1, int palette[8])
+{
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1)
+    {
+        for (int i = 1; i < 7; i++) palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    }
+    else
+    {
+        for (int i = 1; i < 5; i++) palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// Picks the closest palette entry for every pixel, returns the total squared error
+static int alpha_indices(const uint8_t block[16][4], int a0, int a1, uint64_t& indices)
+{
+    int palette[8];
+    alpha_palette(a0, a1, palette);
+
+    int error = 0;
+    indices = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0, best_error = 256 * 256;
+        for (int p = 0; p < 8; p++)
+        {
+            int difference = block[i][3] - palette[p];
+            if (difference * difference < best_error)
+            {
+                best = p;
+                best_error = difference * difference;
+            }
+        }
+        error += best_error;
+        indices |= (uint64_t)best << (3 * i);
+    }
+    return error;
+}
+
+/**
+ Two tries: eight interpolated levels between the lowest and highest alpha, or six between the
+ lowest and highest that aren't fully clear or fully solid, plus exact 0 and 255. Sprite edges
+ are mostly the second kind.
+ */
+static void encode_alpha(const uint8_t block[16][4], uint8_t* out)
+{
+    int low = 255, high = 0, inner_low = 255, inner_high = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int alpha = block[i][3];
+        low = std::min(low, alpha);
+        high = std::max(high, alpha);
+        if (alpha != 0 && alpha != 255)
+        {
+            inner_low = std::min(inner_low, alpha);
+            inner_high = std::max(inner_high, alpha);
+        }
+    }
+    if (inner_low > inner_high) inner_low = inner_high = 0;
+
+    uint64_t indices, inner_indices;
+    int a0 = high, a1 = low;
+    int error = alpha_indices(block, a0, a1, indices);
+    if (error > 0 && alpha_indices(block, inner_low, inner_high, inner_indices) < error)
+    {
+        a0 = inner_low;
+        a1 = inner_high;
+        indices = inner_indices;
+    }
+
+    out[0] = (uint8_t)a0;
+    out[1] = (uint8_t)a1;
+    for (int i = 0; i < 6; i++) out[2 + i] = (uint8_t)(indices >> (8 * i));
+}
+
+// Four colour mode needs the first endpoint larger, callers swap them first. Equal endpoints
+// just use index 0 everywhere.
+static uint32_t colour_indices(const uint8_t block[16][4], uint16_t c0, uint16_t c1)
+{
+    if (c0 == c1) return 0;
+
+    int palette[4][3];
+    colour_palette(c0, c1, palette);
+    uint32_t indices = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0, best_error = 1 << 30;
+        for (int p = 0; p < 4; p++)
+        {
+            int r = block[i][0] - palette[p][0], g = block[i][1] - palette[p][1], b = block[i][2] - palette[p][2];
+            int error = r * r + g * g + b * b;
+            if (error < best_error)
+            {
+                best = p;
+                best_error = error;
+            }
+        }
+        indices |= (uint32_t)best << (2 * i);
+    }
+    return indices;
+}
+
+static int colour_error(const uint8_t block[16][4], uint16_t c0, uint16_t c1, uint32_t indices)
+{
+    int palette[4][3];
+    colour_palette(c0, c1, palette);
+    int error = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        const int* colour = palette[(indices >> (2 * i)) & 3];
+        int r = block[i][0] - colour[0], g = block[i][1] - colour[1], b = block[i][2] - colour[2];
+        error += r * r + g * g + b * b;
+    }
+    return error;
+}
+
+/**
+ Endpoints go along the block's main axis of colour variation (found by power iteration on the
+ covariance), pulled in slightly from the extremes since the ends of the line are rarely the
+ best fit for the pixels in between.
+ */
+static void encode_colour(const uint8_t block[16][4], uint8_t* out)
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++) mean[c] += block[i][c] / 16.0f;
+    }
+
+    float covariance[6] = { 0.0f };  // rr rg rb gg gb bb
+    for (int i = 0; i < 16; i++)
+    {
+        float r = block[i][0] - mean[0], g = block[i][1] - mean[1], b = block[i][2] - mean[2];
+        covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+        covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+    }
+
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[3] = {
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2],
+        };
+        float length = std::max(std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+        if (length < 1e-6f) break;  // flat colour, any axis will do
+        for (int c = 0; c < 3; c++) axis[c] = next[c] / length;
+    }
+
+    float low = 1e9f, high = -1e9f, axis_length = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    for (int i = 0; i < 16; i++)
+    {
+        float t = ((block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2]) / axis_length;
+        low = std::min(low, t);
+        high = std::max(high, t);
+    }
+    float inset = (high - low) / 16.0f;
+    low += inset;
+    high -= inset;
+
+    float end_0[3], end_1[3];
+    for (int c = 0; c < 3; c++)
+    {
+        end_0[c] = mean[c] + axis[c] * high;
+        end_1[c] = mean[c] + axis[c] * low;
+    }
+    uint16_t c0 = pack_565(end_0), c1 = pack_565(end_1);
+    if (c0 < c1) std::swap(c0, c1);
+
+    // then, with each pixel's palette slot known, solve for the endpoints that fit those slots
+    // best in the least squares sense, and pick slots again. Going round again gains next to nothing.
+    uint32_t indices = colour_indices(block, c0, c1);
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = { 0.0f }, bx[3] = { 0.0f };
+    for (int i = 0; i < 16; i++)
+    {
+        // slot 0, 1, 2, 3 sit at weight 1, 0, 2/3, 1/3 of the way from end_1 to end_0
+        static const float WEIGHTS[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float a = WEIGHTS[(indices >> (2 * i)) & 3], b = 1.0f - a;
+        aa += a * a; ab += a * b; bb += b * b;
+        for (int c = 0; c < 3; c++)
+        {
+            ax[c] += a * block[i][c];
+            bx[c] += b * block[i][c];
+        }
+    }
+
+    // zero when every pixel landed in the same slot, nothing to solve then
+    float determinant = aa * bb - ab * ab;
+    if (c0 != c1 && std::fabs(determinant) > 1e-6f)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            end_0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+            end_1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+        }
+        uint16_t refined_0 = pack_565(end_0), refined_1 = pack_565(end_1);
+        if (refined_0 < refined_1) std::swap(refined_0, refined_1);
+        uint32_t refined_indices = colour_indices(block, refined_0, refined_1);
+        if (colour_error(block, refined_0, refined_1, refined_indices) < colour_error(block, c0, c1, indices))
+        {
+            c0 = refined_0;
+            c1 = refined_1;
+            indices = refined_indices;
+        }
+    }
+
+    out[0] = (uint8_t)c0; out[1] = (uint8_t)(c0 >> 8);
+    out[2] = (uint8_t)c1; out[3] = (uint8_t)(c1 >> 8);
+    for (int i = 0; i < 4; i++) out[4 + i] = (uint8_t)(indices >> (8 * i));
+}
+
+void compress_bc3(const uint8_t* pixels, int width, int height, uint8_t* out)
+{
+    uint8_t block[16][4];
+    for (int block_y = 0; block_y < height; block_y += 4)
+    {
+        for (int block_x = 0; block_x < width; block_x += 4)
+        {
+            for (int i = 0; i < 16; i++)
+            {
+                int x = std::min(block_x + i % 4, width - 1), y = std::min(block_y + i / 4, height - 1);
+                memcpy(block[i], &pixels[((size_t)y * width + x) * 4], 4);
+            }
+            encode_alpha(block, out);
+            encode_colour(block, out + 8);
+            out += BC3_BLOCK_SIZE;
+        }
+    }
+}
+
+void decompress_bc3(const uint8_t* blocks, int width, int height, uint8_t* out)
+{
+    for (int block_y = 0; block_y < height; block_y += 4)
+    {
+        for (int block_x = 0; block_x < width; block_x += 4)
+        {
+            int alphas[8], colours[4][3];
+            alpha_palette(blocks[0], blocks[1], alphas);
+            colour_palette((uint16_t)(blocks[8] | blocks[9] << 8), (uint16_t)(blocks[10] | blocks[11] << 8), colours);
+
+            uint64_t alpha_indices = 0;
+            for (int i = 0; i < 6; i++) alpha_indices |= (uint64_t)blocks[2 + i] << (8 * i);
+            uint32_t colour_indices = blocks[12] | blocks[13] << 8 | blocks[14] << 16 | (uint32_t)blocks[15] << 24;
+
+            for (int i = 0; i < 16; i++)
+            {
+                int x = block_x + i % 4, y = block_y + i / 4;
+                if (x >= width || y >= height) continue;
+
+                uint8_t* pixel = &out[((size_t)y * width + x) * 4];
+                const int* colour = colours[(colour_indices >> (2 * i)) & 3];
+                pixel[0] = (uint8_t)colour[0];
+                pixel[1] = (uint8_t)colour[1];
+                pixel[2] = (uint8_t)colour[2];
+                pixel[3] = (uint8_t)alphas[(alpha_indices >> (3 * i)) & 7];
+            }
+            blocks += BC3_BLOCK_SIZE;
+        }
+    }
+}
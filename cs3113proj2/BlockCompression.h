@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ BC3 (a.k.a. DXT5): every 4x4 block of RGBA8 pixels packs into 16 bytes, a quarter of the
+ size, and stays that size on the GPU. Each block is an alpha half (two 8 bit endpoints,
+ 3 bit indices) followed by a colour half (two 565 endpoints, 2 bit indices).
+
+ Images that aren't a multiple of 4 get partial blocks on the right and bottom edges, padded
+ out by repeating the last row and column.
+ */
+constexpr size_t BC3_BLOCK_SIZE = 16;
+
+inline size_t bc3_size(int width, int height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BC3_BLOCK_SIZE;
+}
+
+// pixels is width x height RGBA8, out needs bc3_size(width, height) bytes
+void compress_bc3(const uint8_t* pixels, int width, int height, uint8_t* out);
+
+// The other way, for drivers without S3TC. out needs width * height * 4 bytes.
+void decompress_bc3(const uint8_t* blocks, int width, int height, uint8_t* out);
@@ -0,0 +1,31 @@
+#define GL_SILENCE_DEPRECATION
+
+#include "CameraBuffer.h"
+
+void CameraBuffer::initialise()
+{
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, m_buffer);
+    m_uploaded = false;
+}
+
+void CameraBuffer::shutdown()
+{
+    glDeleteBuffers(1, &m_buffer);
+    GLState::invalidate();
+}
+
+void CameraBuffer::update(const glm::mat4& view, const glm::mat4& projection)
+{
+    glm::mat4 view_projection = projection * view;
+    if (m_uploaded && view_projection == m_view_projection) return;
+
+    // glBindBufferBase above also bound it to the generic GL_UNIFORM_BUFFER target, but
+    // something else may have taken that since, so bind before writing
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), &view_projection[0][0]);
+    m_view_projection = view_projection;
+    m_uploaded = true;
+}
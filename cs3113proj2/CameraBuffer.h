@@ -0,0 +1,29 @@
+#pragma once
+
+#include "GLState.h"
+#include "glm/mat4x4.hpp"
+
+constexpr GLuint CAMERA_BINDING = 0;  // uniform buffer binding point every program's Camera block reads from
+
+/**
+ The per-frame camera, in a uniform buffer every program shares. Shaders declare
+
+     layout(std140) uniform Camera { mat4 viewProjection; };
+
+ and ShaderProgram::bind_uniform_block("Camera", CAMERA_BINDING) hooks them up. View and
+ projection are multiplied once here rather than per vertex.
+ */
+class CameraBuffer
+{
+public:
+    void initialise();
+    void shutdown();
+
+    // Only uploads when the matrix actually changed
+    void update(const glm::mat4& view, const glm::mat4& projection);
+
+private:
+    GLuint m_buffer = 0;
+    glm::mat4 m_view_projection = glm::mat4(0.0f);
+    bool m_uploaded = false;
+};
@@ -0,0 +1,328 @@
+#include "Collision.h"
+#include <cassert>
+#include <cmath>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define COLLISION_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define COLLISION_SSE2 1
+#endif
+
+// Function to clamp a value between min and max, helper function to find closest point on box to circle
+static float clamp(float value, float min, float max) {
+    if (value < min) return min;
+    if (value > max) return max;
+    return value;
+}
+
+// One circle against every box, used on its own when there's no SIMD and for the leftovers otherwise
+static void collide_one(float cx, float cy, float radius,
+                        const float* box_x, const float* box_y,
+                        const float* box_half_width, const float* box_half_height, size_t box_count,
+                        uint32_t& hit_mask, float& normal_x, float& normal_y, float& depth)
+{
+    hit_mask = 0;
+    normal_x = normal_y = depth = 0.0f;
+
+    for (size_t j = 0; j < box_count; j++)
+    {
+        // Find the closest point on the box to the circle
+        float closest_x = clamp(cx, box_x[j] - box_half_width[j], box_x[j] + box_half_width[j]);
+        float closest_y = clamp(cy, box_y[j] - box_half_height[j], box_y[j] + box_half_height[j]);
+
+        float dx = cx - closest_x;
+        float dy = cy - closest_y;
+        float distance_squared = dx * dx + dy * dy;
+        if (distance_squared > radius * radius) continue;
+
+        float nx, ny, d;
+        if (distance_squared > 0.0f)
+        {
+            float distance = sqrtf(distance_squared);
+            nx = dx / distance;
+            ny = dy / distance;
+            d = radius - distance;
+        }
+        else
+        {
+            // centre is inside the box, push out along whichever side is nearest
+            float offset_x = cx - box_x[j], offset_y = cy - box_y[j];
+            float push_x = box_half_width[j] - fabsf(offset_x);
+            float push_y = box_half_height[j] - fabsf(offset_y);
+            if (push_x < push_y) { nx = offset_x < 0.0f ? -1.0f : 1.0f; ny = 0.0f; d = push_x + radius; }
+            else                 { nx = 0.0f; ny = offset_y < 0.0f ? -1.0f : 1.0f; d = push_y + radius; }
+        }
+
+        hit_mask |= 1u << j;
+        if (d > depth)
+        {
+            normal_x = nx;
+            normal_y = ny;
+            depth = d;
+        }
+    }
+}
+
+#if COLLISION_SSE2 && !COLLISION_AVX2
+// Four circles at a time. Same maths as collide_one, with the branches turned into masks.
+static size_t collide_sse2(const float* circle_x, const float* circle_y, size_t circle_count, float radius,
+                           const float* box_x, const float* box_y,
+                           const float* box_half_width, const float* box_half_height, size_t box_count,
+                           uint32_t* hit_masks, float* normal_x, float* normal_y, float* depth)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 sign_bit = _mm_set1_ps(-0.0f);
+    const __m128 r = _mm_set1_ps(radius);
+    const __m128 r2 = _mm_mul_ps(r, r);
+
+    size_t i = 0;
+    for (; i + 4 <= circle_count; i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(circle_x + i);
+        __m128 cy = _mm_loadu_ps(circle_y + i);
+
+        __m128i mask = _mm_setzero_si128();
+        __m128 best_nx = zero, best_ny = zero, best_depth = zero;
+
+        for (size_t j = 0; j < box_count; j++)
+        {
+            __m128 bx = _mm_set1_ps(box_x[j]), by = _mm_set1_ps(box_y[j]);
+            __m128 hw = _mm_set1_ps(box_half_width[j]), hh = _mm_set1_ps(box_half_height[j]);
+
+            __m128 offset_x = _mm_sub_ps(cx, bx);
+            __m128 offset_y = _mm_sub_ps(cy, by);
+            __m128 dx = _mm_sub_ps(offset_x, _mm_max_ps(_mm_min_ps(offset_x, hw), _mm_sub_ps(zero, hw)));
+            __m128 dy = _mm_sub_ps(offset_y, _mm_max_ps(_mm_min_ps(offset_y, hh), _mm_sub_ps(zero, hh)));
+            __m128 distance_squared = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+            __m128 hit = _mm_cmple_ps(distance_squared, r2);
+            if (_mm_movemask_ps(hit) == 0) continue;
+
+            // outside the box: normal is the direction from the closest point
+            __m128 outside = _mm_cmpgt_ps(distance_squared, zero);
+            __m128 distance = _mm_sqrt_ps(distance_squared);
+            __m128 safe_distance = _mm_or_ps(_mm_and_ps(outside, distance), _mm_andnot_ps(outside, one));
+            __m128 out_nx = _mm_div_ps(dx, safe_distance);
+            __m128 out_ny = _mm_div_ps(dy, safe_distance);
+            __m128 out_depth = _mm_sub_ps(r, distance);
+
+            // inside the box: push out through the nearest side
+            __m128 push_x = _mm_sub_ps(hw, _mm_andnot_ps(sign_bit, offset_x));
+            __m128 push_y = _mm_sub_ps(hh, _mm_andnot_ps(sign_bit, offset_y));
+            __m128 use_x = _mm_cmplt_ps(push_x, push_y);
+            __m128 sign_x = _mm_or_ps(one, _mm_and_ps(sign_bit, offset_x));
+            __m128 sign_y = _mm_or_ps(one, _mm_and_ps(sign_bit, offset_y));
+            __m128 in_nx = _mm_and_ps(use_x, sign_x);
+            __m128 in_ny = _mm_andnot_ps(use_x, sign_y);
+            __m128 in_depth = _mm_add_ps(_mm_or_ps(_mm_and_ps(use_x, push_x), _mm_andnot_ps(use_x, push_y)), r);
+
+            __m128 nx = _mm_or_ps(_mm_and_ps(outside, out_nx), _mm_andnot_ps(outside, in_nx));
+            __m128 ny = _mm_or_ps(_mm_and_ps(outside, out_ny), _mm_andnot_ps(outside, in_ny));
+            __m128 d = _mm_or_ps(_mm_and_ps(outside, out_depth), _mm_andnot_ps(outside, in_depth));
+
+            __m128 deeper = _mm_and_ps(hit, _mm_cmpgt_ps(d, best_depth));
+            best_nx = _mm_or_ps(_mm_and_ps(deeper, nx), _mm_andnot_ps(deeper, best_nx));
+            best_ny = _mm_or_ps(_mm_and_ps(deeper, ny), _mm_andnot_ps(deeper, best_ny));
+            best_depth = _mm_or_ps(_mm_and_ps(deeper, d), _mm_andnot_ps(deeper, best_depth));
+
+            mask = _mm_or_si128(mask, _mm_and_si128(_mm_castps_si128(hit), _mm_set1_epi32((int)(1u << j))));
+        }
+
+        _mm_storeu_si128((__m128i*)(hit_masks + i), mask);
+        _mm_storeu_ps(normal_x + i, best_nx);
+        _mm_storeu_ps(normal_y + i, best_ny);
+        _mm_storeu_ps(depth + i, best_depth);
+    }
+    return i;
+}
+#endif
+
+#if COLLISION_AVX2
+// Eight circles at a time, otherwise identical to the SSE2 version
+static size_t collide_avx2(const float* circle_x, const float* circle_y, size_t circle_count, float radius,
+                           const float* box_x, const float* box_y,
+                           const float* box_half_width, const float* box_half_height, size_t box_count,
+                           uint32_t* hit_masks, float* normal_x, float* normal_y, float* depth)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 sign_bit = _mm256_set1_ps(-0.0f);
+    const __m256 r = _mm256_set1_ps(radius);
+    const __m256 r2 = _mm256_mul_ps(r, r);
+
+    size_t i = 0;
+    for (; i + 8 <= circle_count; i += 8)
+    {
+        __m256 cx = _mm256_loadu_ps(circle_x + i);
+        __m256 cy = _mm256_loadu_ps(circle_y + i);
+
+        __m256i mask = _mm256_setzero_si256();
+        __m256 best_nx = zero, best_ny = zero, best_depth = zero;
+
+        for (size_t j = 0; j < box_count; j++)
+        {
+            __m256 bx = _mm256_set1_ps(box_x[j]), by = _mm256_set1_ps(box_y[j]);
+            __m256 hw = _mm256_set1_ps(box_half_width[j]), hh = _mm256_set1_ps(box_half_height[j]);
+
+            __m256 offset_x = _mm256_sub_ps(cx, bx);
+            __m256 offset_y = _mm256_sub_ps(cy, by);
+            __m256 dx = _mm256_sub_ps(offset_x, _mm256_max_ps(_mm256_min_ps(offset_x, hw), _mm256_sub_ps(zero, hw)));
+            __m256 dy = _mm256_sub_ps(offset_y, _mm256_max_ps(_mm256_min_ps(offset_y, hh), _mm256_sub_ps(zero, hh)));
+            __m256 distance_squared = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+
+            __m256 hit = _mm256_cmp_ps(distance_squared, r2, _CMP_LE_OQ);
+            if (_mm256_movemask_ps(hit) == 0) continue;
+
+            __m256 outside = _mm256_cmp_ps(distance_squared, zero, _CMP_GT_OQ);
+            __m256 distance = _mm256_sqrt_ps(distance_squared);
+            __m256 safe_distance = _mm256_blendv_ps(one, distance, outside);
+            __m256 out_nx = _mm256_div_ps(dx, safe_distance);
+            __m256 out_ny = _mm256_div_ps(dy, safe_distance);
+            __m256 out_depth = _mm256_sub_ps(r, distance);
+
+            __m256 push_x = _mm256_sub_ps(hw, _mm256_andnot_ps(sign_bit, offset_x));
+            __m256 push_y = _mm256_sub_ps(hh, _mm256_andnot_ps(sign_bit, offset_y));
+            __m256 use_x = _mm256_cmp_ps(push_x, push_y, _CMP_LT_OQ);
+            __m256 sign_x = _mm256_or_ps(one, _mm256_and_ps(sign_bit, offset_x));
+            __m256 sign_y = _mm256_or_ps(one, _mm256_and_ps(sign_bit, offset_y));
+            __m256 in_nx = _mm256_and_ps(use_x, sign_x);
+            __m256 in_ny = _mm256_andnot_ps(use_x, sign_y);
+            __m256 in_depth = _mm256_add_ps(_mm256_blendv_ps(push_y, push_x, use_x), r);
+
+            __m256 nx = _mm256_blendv_ps(in_nx, out_nx, outside);
+            __m256 ny = _mm256_blendv_ps(in_ny, out_ny, outside);
+            __m256 d = _mm256_blendv_ps(in_depth, out_depth, outside);
+
+            __m256 deeper = _mm256_and_ps(hit, _mm256_cmp_ps(d, best_depth, _CMP_GT_OQ));
+            best_nx = _mm256_blendv_ps(best_nx, nx, deeper);
+            best_ny = _mm256_blendv_ps(best_ny, ny, deeper);
+            best_depth = _mm256_blendv_ps(best_depth, d, deeper);
+
+            mask = _mm256_or_si256(mask, _mm256_and_si256(_mm256_castps_si256(hit), _mm256_set1_epi32((int)(1u << j))));
+        }
+
+        _mm256_storeu_si256((__m256i*)(hit_masks + i), mask);
+        _mm256_storeu_ps(normal_x + i, best_nx);
+        _mm256_storeu_ps(normal_y + i, best_ny);
+        _mm256_storeu_ps(depth + i, best_depth);
+    }
+    return i;
+}
+#endif
+
+void collide_circles_boxes(const float* circle_x, const float* circle_y, size_t circle_count, float radius,
+                           const float* box_x, const float* box_y,
+                           const float* box_half_width, const float* box_half_height, size_t box_count,
+                           uint32_t* hit_masks, float* normal_x, float* normal_y, float* depth)
+{
+    assert(box_count <= MAX_COLLISION_BOXES);
+
+    size_t done = 0;
+#if COLLISION_AVX2
+    done = collide_avx2(circle_x, circle_y, circle_count, radius, box_x, box_y, box_half_width, box_half_height, box_count,
+                        hit_masks, normal_x, normal_y, depth);
+#elif COLLISION_SSE2
+    done = collide_sse2(circle_x, circle_y, circle_count, radius, box_x, box_y, box_half_width, box_half_height, box_count,
+                        hit_masks, normal_x, normal_y, depth);
+#endif
+
+    for (size_t i = done; i < circle_count; i++)
+    {
+        collide_one(circle_x[i], circle_y[i], radius, box_x, box_y, box_half_width, box_half_height, box_count,
+                    hit_masks[i], normal_x[i], normal_y[i], depth[i]);
+    }
+}
+
+// First time the ray p + v t comes within radius of the corner c, or false if it never does in time
+static bool sweep_corner(float px, float py, float vx, float vy, float corner_x, float corner_y, float radius,
+                         float max_time, float& time, float& normal_x, float& normal_y)
+{
+    float offset_x = px - corner_x, offset_y = py - corner_y;
+    float a = vx * vx + vy * vy;
+    float b = offset_x * vx + offset_y * vy;
+    float c = offset_x * offset_x + offset_y * offset_y - radius * radius;
+    if (a == 0.0f || b >= 0.0f) return false;  // not moving, or moving away
+
+    float discriminant = b * b - a * c;
+    if (discriminant < 0.0f) return false;
+
+    float t = (-b - sqrtf(discriminant)) / a;
+    if (t < 0.0f || t > max_time) return false;
+
+    time = t;
+    normal_x = (offset_x + vx * t) / radius;
+    normal_y = (offset_y + vy * t) / radius;
+    return true;
+}
+
+bool sweep_circle_box(float x, float y, float velocity_x, float velocity_y, float radius,
+                      float box_x, float box_y, float box_half_width, float box_half_height,
+                      float max_time, float& time, float& normal_x, float& normal_y)
+{
+    // Work relative to the box centre. A circle touching the box is the same as its centre
+    // touching the box grown by the radius with rounded corners.
+    float px = x - box_x, py = y - box_y;
+    float extent_x = box_half_width + radius, extent_y = box_half_height + radius;
+
+    if (fabsf(px) < extent_x && fabsf(py) < extent_y)
+    {
+        // inside the grown box, but maybe only in the cut-off bit of a corner
+        if (fabsf(px) <= box_half_width || fabsf(py) <= box_half_height) return false;
+
+        float corner_x = px < 0.0f ? -box_half_width : box_half_width;
+        float corner_y = py < 0.0f ? -box_half_height : box_half_height;
+        float dx = px - corner_x, dy = py - corner_y;
+        if (dx * dx + dy * dy < radius * radius) return false;
+
+        return sweep_corner(px, py, velocity_x, velocity_y, corner_x, corner_y, radius, max_time, time, normal_x, normal_y);
+    }
+
+    // slab test against the grown box
+    float enter_x = -INFINITY, exit_x = INFINITY;
+    if (velocity_x != 0.0f)
+    {
+        float t1 = (-extent_x - px) / velocity_x, t2 = (extent_x - px) / velocity_x;
+        enter_x = t1 < t2 ? t1 : t2;
+        exit_x = t1 < t2 ? t2 : t1;
+    }
+    else if (fabsf(px) >= extent_x) return false;
+
+    float enter_y = -INFINITY, exit_y = INFINITY;
+    if (velocity_y != 0.0f)
+    {
+        float t1 = (-extent_y - py) / velocity_y, t2 = (extent_y - py) / velocity_y;
+        enter_y = t1 < t2 ? t1 : t2;
+        exit_y = t1 < t2 ? t2 : t1;
+    }
+    else if (fabsf(py) >= extent_y) return false;
+
+    float enter = enter_x > enter_y ? enter_x : enter_y;
+    float exit = exit_x < exit_y ? exit_x : exit_y;
+    if (enter > exit || enter < 0.0f || enter > max_time) return false;
+
+    // landing in a corner square means it's really the rounded corner we have to hit
+    float hit_x = px + velocity_x * enter, hit_y = py + velocity_y * enter;
+    if (fabsf(hit_x) > box_half_width && fabsf(hit_y) > box_half_height)
+    {
+        float corner_x = hit_x < 0.0f ? -box_half_width : box_half_width;
+        float corner_y = hit_y < 0.0f ? -box_half_height : box_half_height;
+        return sweep_corner(px, py, velocity_x, velocity_y, corner_x, corner_y, radius, max_time, time, normal_x, normal_y);
+    }
+
+    time = enter;
+    if (enter_x > enter_y)
+    {
+        normal_x = velocity_x > 0.0f ? -1.0f : 1.0f;
+        normal_y = 0.0f;
+    }
+    else
+    {
+        normal_x = 0.0f;
+        normal_y = velocity_y > 0.0f ? -1.0f : 1.0f;
+    }
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr size_t MAX_COLLISION_BOXES = 32;  // one bit per box in the hit masks
+
+/**
+ Tests every circle against every axis-aligned box in one go.
+
+ Boxes are given by centre and half extents. For each circle i:
+   hit_masks[i]   has bit j set if the circle overlaps box j
+   normal_x/y[i]  unit normal of the deepest contact, pointing from the box towards the circle
+   depth[i]       how far the circle has to move along that normal to stop overlapping
+ Circles that hit nothing get a zero mask, normal and depth.
+
+ Uses AVX2 when compiled for it, SSE2 otherwise on x86, and plain scalar code elsewhere.
+ */
+void collide_circles_boxes(const float* circle_x, const float* circle_y, size_t circle_count, float radius,
+                           const float* box_x, const float* box_y,
+                           const float* box_half_width, const float* box_half_height, size_t box_count,
+                           uint32_t* hit_masks, float* normal_x, float* normal_y, float* depth);
+
+/**
+ Swept test for one moving circle against one axis-aligned box.
+
+ Finds the first time in [0, max_time] at which a circle starting at (x, y) and moving with
+ velocity (velocity_x, velocity_y) touches the box, along with the surface normal there
+ (pointing out of the box). Returns false if it doesn't get there in time, and also if the
+ circle is already overlapping at the start. collide_circles_boxes() is the one for that.
+ */
+bool sweep_circle_box(float x, float y, float velocity_x, float velocity_y, float radius,
+                      float box_x, float box_y, float box_half_width, float box_half_height,
+                      float max_time, float& time, float& normal_x, float& normal_y);
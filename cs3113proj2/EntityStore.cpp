@@ -0,0 +1,132 @@
+#include "EntityStore.h"
+#include <algorithm>
+
+size_t EntityStore::add(float x, float y, float entity_scale_x, float entity_scale_y, SpriteId entity_sprite)
+{
+    position_x.push_back(x);
+    position_y.push_back(y);
+    previous_x.push_back(x);
+    previous_y.push_back(y);
+    movement_x.push_back(0.0f);
+    movement_y.push_back(0.0f);
+    speed.push_back(0.0f);
+    rotation.push_back(0.0f);
+    previous_rotation.push_back(0.0f);
+    spin.push_back(1.0f);
+    scale_x.push_back(entity_scale_x);
+    scale_y.push_back(entity_scale_y);
+    hit_time.push_back(0.0f);
+    hit.push_back(0);
+    sprite.push_back(entity_sprite);
+    id.push_back(next_id++);
+
+    return size() - 1;
+}
+
+size_t EntityStore::find(uint32_t entity_id) const
+{
+    return std::find(id.begin(), id.end(), entity_id) - id.begin();
+}
+
+template <typename T>
+static void swap_remove(std::vector<T>& array, size_t index)
+{
+    array[index] = array.back();
+    array.pop_back();
+}
+
+void EntityStore::remove(size_t index)
+{
+    swap_remove(position_x, index);
+    swap_remove(position_y, index);
+    swap_remove(previous_x, index);
+    swap_remove(previous_y, index);
+    swap_remove(movement_x, index);
+    swap_remove(movement_y, index);
+    swap_remove(speed, index);
+    swap_remove(rotation, index);
+    swap_remove(previous_rotation, index);
+    swap_remove(spin, index);
+    swap_remove(scale_x, index);
+    swap_remove(scale_y, index);
+    swap_remove(hit_time, index);
+    swap_remove(hit, index);
+    swap_remove(sprite, index);
+    swap_remove(id, index);
+}
+
+void EntityStore::clear()
+{
+    position_x.clear();
+    position_y.clear();
+    previous_x.clear();
+    previous_y.clear();
+    movement_x.clear();
+    movement_y.clear();
+    speed.clear();
+    rotation.clear();
+    previous_rotation.clear();
+    spin.clear();
+    scale_x.clear();
+    scale_y.clear();
+    hit_time.clear();
+    hit.clear();
+    sprite.clear();
+    id.clear();
+    next_id = 0;
+}
+
+void EntityStore::reserve(size_t count)
+{
+    position_x.reserve(count);
+    position_y.reserve(count);
+    previous_x.reserve(count);
+    previous_y.reserve(count);
+    movement_x.reserve(count);
+    movement_y.reserve(count);
+    speed.reserve(count);
+    rotation.reserve(count);
+    previous_rotation.reserve(count);
+    spin.reserve(count);
+    scale_x.reserve(count);
+    scale_y.reserve(count);
+    hit_time.reserve(count);
+    hit.reserve(count);
+    sprite.reserve(count);
+    id.reserve(count);
+}
+
+template <typename T>
+static void gather(std::vector<T>& array, const uint32_t* order)
+{
+    std::vector<T> gathered(array.size());
+    for (size_t k = 0; k < array.size(); k++) gathered[k] = array[order[k]];
+    array.swap(gathered);
+}
+
+void EntityStore::reorder(const uint32_t* order)
+{
+    gather(position_x, order);
+    gather(position_y, order);
+    gather(previous_x, order);
+    gather(previous_y, order);
+    gather(movement_x, order);
+    gather(movement_y, order);
+    gather(speed, order);
+    gather(rotation, order);
+    gather(previous_rotation, order);
+    gather(spin, order);
+    gather(scale_x, order);
+    gather(scale_y, order);
+    gather(hit_time, order);
+    gather(hit, order);
+    gather(sprite, order);
+    gather(id, order);
+}
+
+void EntityStore::save_previous()
+{
+    std::copy(position_x.begin(), position_x.end(), previous_x.begin());
+    std::copy(position_y.begin(), position_y.end(), previous_y.begin());
+    std::copy(rotation.begin(), rotation.end(), previous_rotation.begin());
+}
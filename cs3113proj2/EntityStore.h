@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Which picture an entity is drawn with. The simulation only deals in these,
+// render() maps them to actual GL textures.
+enum SpriteId : unsigned char { SPRITE_BLUE, SPRITE_PINK, SPRITE_BALL, SPRITE_HIT, SPRITE_COUNT };
+
+/**
+ Structure-of-arrays storage: entity i is element i of every array, so the
+ per-tick loops walk tightly packed floats instead of hopping between objects.
+ */
+struct EntityStore
+{
+    std::vector<float> position_x, position_y;
+    std::vector<float> previous_x, previous_y;      // as of the last tick, for render interpolation
+    std::vector<float> movement_x, movement_y;      // direction of travel
+    std::vector<float> speed;                       // units per second along the movement
+    std::vector<float> rotation, previous_rotation; // radians about z
+    std::vector<float> spin;                        // +1 or -1, which way the rotation is applied
+    std::vector<float> scale_x, scale_y;
+    std::vector<float> hit_time;                    // seconds since the last hit, only counts while hit
+    std::vector<unsigned char> hit;
+    std::vector<unsigned char> sprite;
+    std::vector<uint32_t> id;                       // follows the entity through remove() and reorder()
+    uint32_t next_id = 0;                           // the id add() gives out next, back to 0 on clear()
+
+    size_t size() const { return position_x.size(); }
+    size_t find(uint32_t entity_id) const;  // index of the entity with this id, size() if it's gone
+
+    size_t add(float x, float y, float scale_x, float scale_y, SpriteId sprite);
+    void remove(size_t index);  // swaps the last entity into the hole, so indices past it change
+    void clear();
+    void reserve(size_t count);
+    void reorder(const uint32_t* order);  // entity k becomes the one that was at order[k]
+    void save_previous();
+};
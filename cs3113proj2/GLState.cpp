@@ -0,0 +1,138 @@
+#include "GLState.h"
+#include <array>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+    constexpr GLuint UNKNOWN = ~0u;  // never a real GL name, so the first call always goes through
+
+    struct Cache
+    {
+        GLuint program = UNKNOWN;
+        GLuint vertex_array = UNKNOWN;
+        GLuint array_buffer = UNKNOWN;
+        GLuint textures[GLState::MAX_TEXTURE_UNITS];
+        int active_unit = -1;
+        int blend_enabled = -1;
+        GLenum blend_source = 0, blend_destination = 0;
+
+        // last value per program and uniform location
+        std::unordered_map<unsigned long long, std::array<float, 16>> uniforms;
+
+        Cache() { for (GLuint& texture : textures) texture = UNKNOWN; }
+    };
+
+    Cache g_cache;
+    GLState::Counters g_frame, g_total;
+    unsigned long long g_frames = 0;
+
+    // true if the call needs to be made, and counts it either way
+    bool changed(bool differs)
+    {
+        if (differs) g_frame.issued++;
+        else g_frame.elided++;
+        return differs;
+    }
+
+    // Compares against the cached copy and updates it, true if it was different
+    bool uniform_changed(GLuint program, GLint location, const float* values, size_t count)
+    {
+        unsigned long long key = (unsigned long long)program << 32 | (unsigned int)location;
+        auto found = g_cache.uniforms.find(key);
+        if (found != g_cache.uniforms.end() && memcmp(found->second.data(), values, count * sizeof(float)) == 0) return changed(false);
+
+        memcpy(g_cache.uniforms[key].data(), values, count * sizeof(float));
+        return changed(true);
+    }
+}
+
+void GLState::use_program(GLuint program)
+{
+    if (changed(g_cache.program != program))
+    {
+        glUseProgram(program);
+        g_cache.program = program;
+    }
+}
+
+void GLState::bind_texture(GLuint texture, int unit)
+{
+    if (!changed(g_cache.textures[unit] != texture)) return;
+
+    if (g_cache.active_unit != unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        g_cache.active_unit = unit;
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    g_cache.textures[unit] = texture;
+}
+
+void GLState::bind_vertex_array(GLuint vertex_array)
+{
+    if (changed(g_cache.vertex_array != vertex_array))
+    {
+        glBindVertexArray(vertex_array);
+        g_cache.vertex_array = vertex_array;
+    }
+}
+
+void GLState::bind_array_buffer(GLuint buffer)
+{
+    if (changed(g_cache.array_buffer != buffer))
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        g_cache.array_buffer = buffer;
+    }
+}
+
+void GLState::set_blend(bool enabled, GLenum source, GLenum destination)
+{
+    if (changed(g_cache.blend_enabled != (int)enabled))
+    {
+        if (enabled) glEnable(GL_BLEND);
+        else glDisable(GL_BLEND);
+        g_cache.blend_enabled = enabled;
+    }
+    if (enabled && changed(g_cache.blend_source != source || g_cache.blend_destination != destination))
+    {
+        glBlendFunc(source, destination);
+        g_cache.blend_source = source;
+        g_cache.blend_destination = destination;
+    }
+}
+
+void GLState::set_uniform_matrix4(GLuint program, GLint location, const float* matrix)
+{
+    if (location < 0 || !uniform_changed(program, location, matrix, 16)) return;
+
+    use_program(program);
+    glUniformMatrix4fv(location, 1, GL_FALSE, matrix);
+}
+
+void GLState::set_uniform4(GLuint program, GLint location, float x, float y, float z, float w)
+{
+    const float values[4] = { x, y, z, w };
+    if (location < 0 || !uniform_changed(program, location, values, 4)) return;
+
+    use_program(program);
+    glUniform4f(location, x, y, z, w);
+}
+
+void GLState::invalidate()
+{
+    g_cache = Cache();
+}
+
+const GLState::Counters& GLState::frame_counters() { return g_frame; }
+const GLState::Counters& GLState::total_counters() { return g_total; }
+unsigned long long GLState::frames() { return g_frames; }
+
+void GLState::end_frame()
+{
+    g_total.issued += g_frame.issued;
+    g_total.elided += g_frame.elided;
+    g_frame = Counters();
+    g_frames++;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#ifdef _WINDOWS
+    #include <GL/glew.h>
+#endif
+#define GL_GLEXT_PROTOTYPES 1
+#include <SDL_opengl.h>
+
+/**
+ Remembers what's currently bound and last uploaded, and skips any call that wouldn't change
+ anything. Everything that binds programs, textures, buffers or VAOs, sets blending or
+ uploads uniforms should go through here, or the cache goes stale. Call invalidate()
+ after anything that might have changed state behind its back, like deleting objects.
+
+ Only for the thread that owns the GL context.
+ */
+namespace GLState
+{
+    constexpr int MAX_TEXTURE_UNITS = 8;
+
+    struct Counters
+    {
+        unsigned long long issued = 0;  // calls that went through to GL
+        unsigned long long elided = 0;  // calls skipped because nothing would change
+    };
+
+    void use_program(GLuint program);
+    void bind_texture(GLuint texture, int unit = 0);  // GL_TEXTURE_2D only
+    void bind_vertex_array(GLuint vertex_array);
+    void bind_array_buffer(GLuint buffer);
+    void set_blend(bool enabled, GLenum source = GL_SRC_ALPHA, GLenum destination = GL_ONE_MINUS_SRC_ALPHA);
+
+    // Binds the program only if the value actually changes
+    void set_uniform_matrix4(GLuint program, GLint location, const float* matrix);
+    void set_uniform4(GLuint program, GLint location, float x, float y, float z, float w);
+
+    void invalidate();
+
+    // Counts since the last end_frame(), and the totals over all finished frames
+    const Counters& frame_counters();
+    const Counters& total_counters();
+    unsigned long long frames();
+    void end_frame();
+}
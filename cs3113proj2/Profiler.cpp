@@ -0,0 +1,126 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#define LOG(argument) std::cout << argument << '\n'
+
+static ProfileEvent g_events[PROFILE_CAPACITY];
+static std::atomic<uint64_t> g_next_event{ 0 };
+static std::atomic<uint32_t> g_next_thread{ 0 };
+static const uint64_t g_origin_ns = Profiler::now_ns();  // so exported times start near zero
+
+uint64_t Profiler::now_ns()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::record(const char* name, uint64_t start_ns, uint64_t end_ns)
+{
+    thread_local uint32_t thread = g_next_thread.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t index = g_next_event.fetch_add(1, std::memory_order_relaxed);
+    ProfileEvent& event = g_events[index & (PROFILE_CAPACITY - 1)];
+    event.name = name;
+    event.start_ns = start_ns;
+    event.end_ns = end_ns;
+    event.thread = thread;
+}
+
+// The surviving events in recording order
+static std::vector<ProfileEvent> collect_events()
+{
+    uint64_t count = g_next_event.load(std::memory_order_acquire);
+    uint64_t first = count > PROFILE_CAPACITY ? count - PROFILE_CAPACITY : 0;
+
+    std::vector<ProfileEvent> events;
+    events.reserve((size_t)(count - first));
+    for (uint64_t i = first; i < count; i++) events.push_back(g_events[i & (PROFILE_CAPACITY - 1)]);
+    return events;
+}
+
+bool Profiler::export_csv(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+    {
+        LOG("Unable to write profile " << path);
+        return false;
+    }
+
+    fprintf(file, "name,thread,start_us,duration_us\n");
+    for (const ProfileEvent& event : collect_events())
+    {
+        fprintf(file, "%s,%u,%.3f,%.3f\n", event.name, event.thread,
+                (event.start_ns - g_origin_ns) / 1000.0, (event.end_ns - event.start_ns) / 1000.0);
+    }
+
+    fclose(file);
+    return true;
+}
+
+bool Profiler::export_chrome_trace(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+    {
+        LOG("Unable to write profile " << path);
+        return false;
+    }
+
+    // complete ("X") events, one per scope, times in microseconds
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (const ProfileEvent& event : collect_events())
+    {
+        fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                first ? "" : ",\n", event.name, event.thread,
+                (event.start_ns - g_origin_ns) / 1000.0, (event.end_ns - event.start_ns) / 1000.0);
+        first = false;
+    }
+    fprintf(file, "\n]}\n");
+
+    fclose(file);
+    return true;
+}
+
+void Profiler::print_summary()
+{
+    std::vector<ProfileEvent> events = collect_events();
+    if (events.empty()) return;
+
+    // group by name, then percentiles within each group
+    std::stable_sort(events.begin(), events.end(), [](const ProfileEvent& a, const ProfileEvent& b) { return strcmp(a.name, b.name) < 0; });
+
+    LOG("scope                count     p50 ms     p95 ms     p99 ms");
+    std::vector<double> durations;
+    for (size_t begin = 0; begin < events.size(); )
+    {
+        size_t end = begin;
+        durations.clear();
+        while (end < events.size() && strcmp(events[end].name, events[begin].name) == 0)
+        {
+            durations.push_back((events[end].end_ns - events[end].start_ns) / 1e6);
+            end++;
+        }
+        std::sort(durations.begin(), durations.end());
+
+        // nearest rank: the smallest value with at least p of the samples at or below it
+        auto percentile = [&durations](double p)
+        {
+            double rank = std::ceil(p * durations.size());
+            return durations[std::min(durations.size() - 1, (size_t)std::max(rank - 1.0, 0.0))];
+        };
+
+        char line[128];
+        snprintf(line, sizeof(line), "%-16s %9zu %10.3f %10.3f %10.3f", events[begin].name, durations.size(),
+                 percentile(0.50), percentile(0.95), percentile(0.99));
+        LOG(line);
+
+        begin = end;
+    }
+}
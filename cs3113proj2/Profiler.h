@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+constexpr size_t PROFILE_CAPACITY = 1 << 16;  // events kept, older ones get overwritten
+
+struct ProfileEvent
+{
+    const char* name;  // always a string literal, so we can keep the pointer
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint32_t thread;   // small per-thread number handed out on first use
+};
+
+/**
+ Timing for named scopes, kept in a fixed ring so recording never allocates or locks.
+ Any thread can record, exporting and summarising should only happen once they've stopped.
+ */
+namespace Profiler
+{
+    uint64_t now_ns();
+    void record(const char* name, uint64_t start_ns, uint64_t end_ns);
+
+    // Everything still in the ring, oldest first
+    bool export_csv(const char* path);
+    bool export_chrome_trace(const char* path);  // load in chrome://tracing or Perfetto
+
+    // p50/p95/p99 for every scope name, to stdout
+    void print_summary();
+}
+
+struct ProfileScope
+{
+    explicit ProfileScope(const char* name) : m_name(name), m_start(Profiler::now_ns()) {}
+    ~ProfileScope() { Profiler::record(m_name, m_start, Profiler::now_ns()); }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    const char* m_name;
+    uint64_t m_start;
+};
+
+#define PROFILE_JOIN_(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_JOIN(profile_scope_, __LINE__)(name)
@@ -0,0 +1,161 @@
+#include "Replay.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#define LOG(argument) std::cout << argument << '\n'
+
+constexpr char REPLAY_MAGIC[4] = { 'P', 'W', 'N', 'G' };
+constexpr uint32_t REPLAY_VERSION = 1;
+
+// direction floats only ever come in as -1, 0 or 1
+static unsigned int pack_direction(float direction) { return direction > 0.0f ? 1u : (direction < 0.0f ? 2u : 0u); }
+static float unpack_direction(unsigned int bits) { return bits == 1u ? 1.0f : (bits == 2u ? -1.0f : 0.0f); }
+
+void Replay::begin(const GameState& state)
+{
+    ball_count = state.balls.size();
+    ball_scale = state.ball_scale;
+    if (ball_count > 0)
+    {
+        serve_y = state.balls.position_y[0];
+        serve_movement_x = state.balls.movement_x[0];
+        serve_movement_y = state.balls.movement_y[0];
+    }
+    tick_count = 0;
+    final_hash = 0;
+    inputs.clear();
+}
+
+void Replay::record(const InputState& input)
+{
+    unsigned int bits = pack_direction(input.pink_direction)
+                      | pack_direction(input.blue_direction) << 2
+                      | (input.toggle_player_two ? 1u : 0u) << 4;
+
+    // a tick can straddle two bytes
+    uint64_t bit = tick_count * REPLAY_BITS_PER_TICK;
+    inputs.resize((bit + REPLAY_BITS_PER_TICK + 7) / 8, 0);
+    inputs[bit / 8] |= (uint8_t)(bits << (bit % 8));
+    if (bit % 8 + REPLAY_BITS_PER_TICK > 8) inputs[bit / 8 + 1] |= (uint8_t)(bits >> (8 - bit % 8));
+
+    tick_count++;
+}
+
+InputState Replay::input_at(uint64_t tick) const
+{
+    InputState input;
+    if (tick >= tick_count) return input;
+
+    uint64_t bit = tick * REPLAY_BITS_PER_TICK;
+    unsigned int bits = inputs[bit / 8] >> (bit % 8);
+    if (bit % 8 + REPLAY_BITS_PER_TICK > 8) bits |= (unsigned int)inputs[bit / 8 + 1] << (8 - bit % 8);
+
+    input.pink_direction = unpack_direction(bits & 3u);
+    input.blue_direction = unpack_direction((bits >> 2) & 3u);
+    input.toggle_player_two = ((bits >> 4) & 1u) != 0;
+    return input;
+}
+
+void Replay::restart(GameState& state) const
+{
+    reset_game(state, (size_t)ball_count, ball_scale);
+    if (state.balls.size() > 0)
+    {
+        state.balls.position_y[0] = state.balls.previous_y[0] = serve_y;
+        state.balls.movement_x[0] = serve_movement_x;
+        state.balls.movement_y[0] = serve_movement_y;
+    }
+}
+
+uint64_t Replay::state_hash(const GameState& state)
+{
+    // FNV-1a over the raw bits, so even the last ulp of drift shows up
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* data, size_t size)
+    {
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 1099511628211ull;
+    };
+    auto mix_store = [&mix](const EntityStore& store)
+    {
+        mix(store.position_x.data(), store.size() * sizeof(float));
+        mix(store.position_y.data(), store.size() * sizeof(float));
+        mix(store.movement_x.data(), store.size() * sizeof(float));
+        mix(store.movement_y.data(), store.size() * sizeof(float));
+    };
+
+    mix(&state.tick, sizeof(state.tick));
+    mix(&state.blue_score, sizeof(state.blue_score));
+    mix(&state.pink_score, sizeof(state.pink_score));
+    mix_store(state.paddles);
+    mix_store(state.balls);
+    return hash;
+}
+
+bool Replay::save(const char* path) const
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        LOG("Unable to write replay " << path);
+        return false;
+    }
+
+    fwrite(REPLAY_MAGIC, 1, sizeof(REPLAY_MAGIC), file);
+    fwrite(&REPLAY_VERSION, sizeof(REPLAY_VERSION), 1, file);
+    fwrite(&ball_count, sizeof(ball_count), 1, file);
+    fwrite(&ball_scale, sizeof(ball_scale), 1, file);
+    fwrite(&serve_y, sizeof(serve_y), 1, file);
+    fwrite(&serve_movement_x, sizeof(serve_movement_x), 1, file);
+    fwrite(&serve_movement_y, sizeof(serve_movement_y), 1, file);
+    fwrite(&tick_count, sizeof(tick_count), 1, file);
+    fwrite(&final_hash, sizeof(final_hash), 1, file);
+    if (!inputs.empty()) fwrite(inputs.data(), 1, inputs.size(), file);
+
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
+
+bool Replay::load(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        LOG("Unable to open replay " << path);
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, REPLAY_MAGIC, sizeof(magic)) == 0
+           && fread(&version, sizeof(version), 1, file) == 1 && version == REPLAY_VERSION
+           && fread(&ball_count, sizeof(ball_count), 1, file) == 1
+           && fread(&ball_scale, sizeof(ball_scale), 1, file) == 1
+           && fread(&serve_y, sizeof(serve_y), 1, file) == 1
+           && fread(&serve_movement_x, sizeof(serve_movement_x), 1, file) == 1
+           && fread(&serve_movement_y, sizeof(serve_movement_y), 1, file) == 1
+           && fread(&tick_count, sizeof(tick_count), 1, file) == 1
+           && fread(&final_hash, sizeof(final_hash), 1, file) == 1;
+
+    if (ok)
+    {
+        // tick_count is only as good as the file, check the inputs it promises are really
+        // there before allocating room for them
+        long header_end = ftell(file);
+        ok = header_end >= 0 && fseek(file, 0, SEEK_END) == 0;
+        long file_end = ok ? ftell(file) : -1;
+        ok = ok && file_end >= header_end && fseek(file, header_end, SEEK_SET) == 0
+             && tick_count <= (uint64_t)(file_end - header_end) * 8 / REPLAY_BITS_PER_TICK;
+    }
+    if (ok)
+    {
+        inputs.assign((size_t)((tick_count * REPLAY_BITS_PER_TICK + 7) / 8), 0);
+        ok = inputs.empty() || fread(inputs.data(), 1, inputs.size(), file) == inputs.size();
+    }
+    fclose(file);
+
+    if (!ok) LOG("Not a valid replay: " << path);
+    return ok;
+}
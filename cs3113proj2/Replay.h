@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Simulation.h"
+#include <cstdint>
+#include <vector>
+
+constexpr int REPLAY_BITS_PER_TICK = 5;  // 2 for each paddle's direction, 1 for the player two toggle
+
+/**
+ A recorded match: just enough to rebuild the starting field, then one tightly packed input
+ per tick. Since step() is deterministic, playing the inputs back through apply_input() and
+ step() lands on exactly the same state, which final_hash lets us check.
+
+ Quitting isn't stored, the match simply ends after tick_count ticks.
+ */
+struct Replay
+{
+    // starting field
+    uint64_t ball_count = 1;
+    float ball_scale = BALL_SCALE;
+    float serve_y = 0.0f, serve_movement_x = 0.0f, serve_movement_y = 0.0f;  // ball 0 can be served differently from reset_game()
+
+    uint64_t tick_count = 0;
+    uint64_t final_hash = 0;        // state_hash() after the last tick
+    std::vector<uint8_t> inputs;    // REPLAY_BITS_PER_TICK bits per tick, low bit first
+
+    // Starts a fresh recording of a match that has just been set up in state
+    void begin(const GameState& state);
+    void record(const InputState& input);
+    void finish(const GameState& state) { final_hash = state_hash(state); }
+
+    // Puts state back where the recording started
+    void restart(GameState& state) const;
+    InputState input_at(uint64_t tick) const;
+
+    bool save(const char* path) const;
+    bool load(const char* path);
+
+    static uint64_t state_hash(const GameState& state);
+};
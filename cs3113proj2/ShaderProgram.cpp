@@ -1,48 +1,241 @@
 #define GL_SILENCE_DEPRECATION
 
 #include "ShaderProgram.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+constexpr uint32_t PROGRAM_CACHE_MAGIC = 0x50524f47;  // "PROG"
+
+// FNV-1a, fine for telling shader versions apart
+static uint64_t hash_string(const std::string &text, uint64_t hash = 14695981039346656037ull)
+{
+    for (unsigned char c : text) hash = (hash ^ c) * 1099511628211ull;
+    return hash;
+}
+
+// ARB_get_program_binary, core from 4.1. GLEW leaves its entry points NULL on drivers without
+// it, and drivers with it can still offer no formats to save in.
+static bool program_binaries_supported()
+{
+#ifdef _WINDOWS
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) return false;
+#endif
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
 
 void ShaderProgram::load(const char *vertex_shader_file, const char *fragment_shader_file) {
     
-    // create the vertex shader
-    m_vertex_shader = load_shader_from_file(vertex_shader_file, GL_VERTEX_SHADER);
-    // create the fragment shader
-    m_fragment_shader = load_shader_from_file(fragment_shader_file, GL_FRAGMENT_SHADER);
+    auto start = std::chrono::steady_clock::now();
     
-    // Create the final shader program from our vertex and fragment shaders
-    m_program_id = glCreateProgram();
-    glAttachShader(m_program_id, m_vertex_shader);
-    glAttachShader(m_program_id, m_fragment_shader);
-    glLinkProgram(m_program_id);
+    std::string vertex_source = read_file(vertex_shader_file);
+    std::string fragment_source = read_file(fragment_shader_file);
     
-    GLint link_success;
-    glGetProgramiv(m_program_id, GL_LINK_STATUS, &link_success);
+    // A binary is only good for the exact same sources on the exact same driver
+    std::string driver = std::string((const char *)glGetString(GL_VENDOR)) + "|" +
+                         (const char *)glGetString(GL_RENDERER) + "|" + (const char *)glGetString(GL_VERSION);
+    uint64_t key = hash_string(driver, hash_string(fragment_source, hash_string(vertex_source)));
+    
+    std::string folder = vertex_shader_file;
+    size_t slash = folder.find_last_of("/\\");
+    folder = slash == std::string::npos ? "" : folder.substr(0, slash + 1);
+    char cache_name[32];
+    snprintf(cache_name, sizeof(cache_name), "program_%016llx.bin", (unsigned long long)key);
+    std::string cache_file = folder + cache_name;
     
-    if(link_success == GL_FALSE)
+    m_vertex_shader = 0;
+    m_fragment_shader = 0;
+    bool cacheable = program_binaries_supported();
+    m_loaded_from_cache = cacheable && load_binary(cache_file);
+    
+    if (!m_loaded_from_cache)
     {
-        printf("Error linking shader program!\n");
+        // create the vertex shader
+        m_vertex_shader = load_shader_from_string(vertex_source, GL_VERTEX_SHADER);
+        // create the fragment shader
+        m_fragment_shader = load_shader_from_string(fragment_source, GL_FRAGMENT_SHADER);
+        
+        // Create the final shader program from our vertex and fragment shaders
+        m_program_id = glCreateProgram();
+        glAttachShader(m_program_id, m_vertex_shader);
+        glAttachShader(m_program_id, m_fragment_shader);
+        if (cacheable) glProgramParameteri(m_program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(m_program_id);
+        
+        GLint link_success;
+        glGetProgramiv(m_program_id, GL_LINK_STATUS, &link_success);
+        
+        if(link_success == GL_FALSE)
+        {
+            printf("Error linking shader program!\n");
+        }
+        else if (cacheable)
+        {
+            save_binary(cache_file);
+        }
     }
     
-    m_model_matrix_uniform      = glGetUniformLocation(m_program_id, "modelMatrix");
-    m_projection_matrix_uniform = glGetUniformLocation(m_program_id, "projectionMatrix");
-    m_view_matrix_uniform       = glGetUniformLocation(m_program_id, "viewMatrix");
-    m_colour_uniform            = glGetUniformLocation(m_program_id, "color");
+    reflect();
+    
+    m_model_matrix_uniform      = get_uniform_location("modelMatrix");
+    m_projection_matrix_uniform = get_uniform_location("projectionMatrix");
+    m_view_matrix_uniform       = get_uniform_location("viewMatrix");
+    m_colour_uniform            = get_uniform_location("color");
     
-    m_position_attribute  = glGetAttribLocation(m_program_id, "position");
-    m_tex_coord_attribute = glGetAttribLocation(m_program_id, "texCoord");
+    m_position_attribute  = get_attribute_location("position");
+    m_tex_coord_attribute = get_attribute_location("texCoord");
     
     set_colour(1.0f, 1.0f, 1.0f, 1.0f);
     
+    m_load_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Cache file: magic, binary format, binary length, then the binary itself.
+// Only call these two when program_binaries_supported().
+bool ShaderProgram::load_binary(const std::string &cache_file)
+{
+    FILE *file = fopen(cache_file.c_str(), "rb");
+    if (file == NULL) return false;
+    
+    uint32_t magic = 0, format = 0, length = 0;
+    std::vector<char> binary;
+    bool ok = fread(&magic, sizeof(magic), 1, file) == 1 && magic == PROGRAM_CACHE_MAGIC
+           && fread(&format, sizeof(format), 1, file) == 1
+           && fread(&length, sizeof(length), 1, file) == 1 && length > 0;
+    if (ok)
+    {
+        binary.resize(length);
+        ok = fread(binary.data(), 1, length, file) == length;
+    }
+    fclose(file);
+    if (!ok) return false;
+    
+    m_program_id = glCreateProgram();
+    glProgramBinary(m_program_id, (GLenum)format, binary.data(), (GLsizei)length);
+    
+    // drivers reject binaries from other versions here, in which case we just compile as usual
+    GLint link_success;
+    glGetProgramiv(m_program_id, GL_LINK_STATUS, &link_success);
+    if (link_success == GL_FALSE)
+    {
+        glDeleteProgram(m_program_id);
+        m_program_id = 0;
+        return false;
+    }
+    return true;
+}
+
+void ShaderProgram::save_binary(const std::string &cache_file) const
+{
+    GLint length = 0;
+    glGetProgramiv(m_program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(m_program_id, length, &length, &format, binary.data());
+    
+    FILE *file = fopen(cache_file.c_str(), "wb");
+    if (file == NULL) return;  // read-only install, we'll just compile every time
+    
+    uint32_t magic = PROGRAM_CACHE_MAGIC, format_32 = format, length_32 = (uint32_t)length;
+    fwrite(&magic, sizeof(magic), 1, file);
+    fwrite(&format_32, sizeof(format_32), 1, file);
+    fwrite(&length_32, sizeof(length_32), 1, file);
+    fwrite(binary.data(), 1, length, file);
+    fclose(file);
+}
+
+// Asks GL for everything that survived linking, so nothing has to hard-code what a shader contains
+void ShaderProgram::reflect()
+{
+    m_uniforms.clear();
+    m_attributes.clear();
+    m_uniform_blocks.clear();
+
+    GLchar name[256];
+    GLsizei name_length;
+    GLint count, size;
+    GLenum type;
+
+    glGetProgramiv(m_program_id, GL_ACTIVE_UNIFORMS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        glGetActiveUniform(m_program_id, i, sizeof(name), &name_length, &size, &type, name);
+
+        // uniforms inside blocks have no location of their own, they're set through the block's buffer
+        GLint location = glGetUniformLocation(m_program_id, name);
+        if (location < 0) continue;
+
+        // arrays are reported as "name[0]", look them up by their plain name too
+        std::string uniform_name(name, name_length);
+        if (uniform_name.size() > 3 && uniform_name.compare(uniform_name.size() - 3, 3, "[0]") == 0)
+        {
+            uniform_name.resize(uniform_name.size() - 3);
+        }
+        m_uniforms[uniform_name] = { location, type, size };
+    }
+
+    glGetProgramiv(m_program_id, GL_ACTIVE_ATTRIBUTES, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        glGetActiveAttrib(m_program_id, i, sizeof(name), &name_length, &size, &type, name);
+        GLint location = glGetAttribLocation(m_program_id, name);
+        if (location < 0) continue;  // built-ins like gl_VertexID
+
+        m_attributes[std::string(name, name_length)] = { location, type, size };
+    }
+
+    glGetProgramiv(m_program_id, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        glGetActiveUniformBlockName(m_program_id, i, sizeof(name), &name_length, name);
+        GLint data_size;
+        glGetActiveUniformBlockiv(m_program_id, i, GL_UNIFORM_BLOCK_DATA_SIZE, &data_size);
+
+        m_uniform_blocks[std::string(name, name_length)] = { i, 0, data_size };
+    }
+}
+
+GLint ShaderProgram::get_uniform_location(const std::string &name) const
+{
+    auto uniform = m_uniforms.find(name);
+    return uniform == m_uniforms.end() ? -1 : uniform->second.location;
+}
+
+GLint ShaderProgram::get_attribute_location(const std::string &name) const
+{
+    auto attribute = m_attributes.find(name);
+    return attribute == m_attributes.end() ? -1 : attribute->second.location;
+}
+
+GLint ShaderProgram::get_uniform_block_index(const std::string &name) const
+{
+    auto block = m_uniform_blocks.find(name);
+    return block == m_uniform_blocks.end() ? -1 : block->second.location;
+}
+
+bool ShaderProgram::bind_uniform_block(const std::string &name, GLuint binding)
+{
+    GLint index = get_uniform_block_index(name);
+    if (index < 0) return false;
+
+    glUniformBlockBinding(m_program_id, (GLuint)index, binding);
+    return true;
 }
 
 void ShaderProgram::cleanup()
 {
     glDeleteProgram(m_program_id);
+    GLState::invalidate();
     glDeleteShader(m_vertex_shader);
     glDeleteShader(m_fragment_shader);
 }
 
-GLuint ShaderProgram::load_shader_from_file(const std::string &shaderFile, GLenum type)
+std::string ShaderProgram::read_file(const std::string &shaderFile) const
 {
     //Open a file stream with the file name
     std::ifstream infile(shaderFile);
@@ -54,9 +247,13 @@ GLuint ShaderProgram::load_shader_from_file(const std::string &shaderFile, GLenu
     //Create a string buffer and stream the file to it
     std::stringstream buffer;
     buffer << infile.rdbuf();
-    
+    return buffer.str();
+}
+
+GLuint ShaderProgram::load_shader_from_file(const std::string &shaderFile, GLenum type)
+{
     // Load the shader from the contents of the file
-    return load_shader_from_string(buffer.str(), type);
+    return load_shader_from_string(read_file(shaderFile), type);
 }
 
 GLuint ShaderProgram::load_shader_from_string(const std::string &shaderContents, GLenum type)
@@ -90,24 +287,20 @@ GLuint ShaderProgram::load_shader_from_string(const std::string &shaderContents,
 
 void ShaderProgram::set_colour(float red, float green, float blue, float alpha)
 {
-    glUseProgram(m_program_id);
-    glUniform4f(m_colour_uniform, red, green, blue, alpha);
+    GLState::set_uniform4(m_program_id, m_colour_uniform, red, green, blue, alpha);
 }
 
 void ShaderProgram::set_view_matrix(const glm::mat4 &matrix)
 {
-    glUseProgram(m_program_id);
-    glUniformMatrix4fv(m_view_matrix_uniform, 1, GL_FALSE, &matrix[0][0]);
+    GLState::set_uniform_matrix4(m_program_id, m_view_matrix_uniform, &matrix[0][0]);
 }
 
 void ShaderProgram::set_model_matrix(const glm::mat4 &matrix)
 {
-    glUseProgram(m_program_id);
-    glUniformMatrix4fv(m_model_matrix_uniform, 1, GL_FALSE, &matrix[0][0]);
+    GLState::set_uniform_matrix4(m_program_id, m_model_matrix_uniform, &matrix[0][0]);
 }
 
 void ShaderProgram::set_projection_matrix(const glm::mat4 &matrix)
 {
-    glUseProgram(m_program_id);
-    glUniformMatrix4fv(m_projection_matrix_uniform, 1, GL_FALSE, &matrix[0][0]);
+    GLState::set_uniform_matrix4(m_program_id, m_projection_matrix_uniform, &matrix[0][0]);
 }
@@ -9,15 +9,29 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <unordered_map>
 #include "glm/mat4x4.hpp"
+#include "GLState.h"
+
+// What linking left active in a program, as reported by GL
+struct ShaderVariable
+{
+    GLint location;  // attribute or uniform location, or the block index for uniform blocks
+    GLenum type;     // GL_FLOAT_MAT4 and so on, 0 for blocks
+    GLint size;      // array length for attributes and uniforms, bytes for blocks
+};
 
 class ShaderProgram
 {
 private:
     void cleanup();
+    void reflect();
+    bool load_binary(const std::string &cache_file);
+    void save_binary(const std::string &cache_file) const;
     
     GLuint load_shader_from_string(const std::string &shader_contents, GLenum shader_type);
     GLuint load_shader_from_file(const std::string &shader_file, GLenum shader_type);
+    std::string read_file(const std::string &file) const;
 
     GLuint m_program_id;
 
@@ -31,16 +45,40 @@ private:
 
     GLuint m_vertex_shader;
     GLuint m_fragment_shader;
+
+    std::unordered_map<std::string, ShaderVariable> m_uniforms;
+    std::unordered_map<std::string, ShaderVariable> m_attributes;
+    std::unordered_map<std::string, ShaderVariable> m_uniform_blocks;
+
+    bool m_loaded_from_cache = false;
+    double m_load_milliseconds = 0.0;
     
 public:
 
+    // Linked programs are cached as driver binaries next to the shaders, keyed by the sources
+    // and the driver, so later launches skip compiling unless something changed
     void load(const char *vertex_shader_file, const char *fragment_shader_file);
 
     void set_model_matrix(const glm::mat4 &matrix);
     void set_projection_matrix(const glm::mat4 &matrix);
     void set_view_matrix(const glm::mat4 &matrix);
     void set_colour(float red, float green, float blue, float alpha);
+
+    // -1 if the program has no such active variable, so callers can treat it as optional
+    GLint get_uniform_location(const std::string &name) const;
+    GLint get_attribute_location(const std::string &name) const;
+    GLint get_uniform_block_index(const std::string &name) const;
+
+    const std::unordered_map<std::string, ShaderVariable> &get_uniforms()       const { return m_uniforms;       };
+    const std::unordered_map<std::string, ShaderVariable> &get_attributes()     const { return m_attributes;     };
+    const std::unordered_map<std::string, ShaderVariable> &get_uniform_blocks() const { return m_uniform_blocks; };
+
+    // Points a uniform block at a binding point shared by every program, false if there's no such block
+    bool bind_uniform_block(const std::string &name, GLuint binding);
     
+    bool loaded_from_cache()     const { return m_loaded_from_cache; };
+    double load_milliseconds()   const { return m_load_milliseconds; };
+
     GLuint const get_program_id()               const { return m_program_id;          };
     GLuint const get_position_attribute()       const { return m_position_attribute;  };
     GLuint const get_tex_coordinate_attribute() const { return m_tex_coord_attribute; };
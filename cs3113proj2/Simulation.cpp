@@ -0,0 +1,457 @@
+#include "Simulation.h"
+#include "Collision.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <iostream>
+
+constexpr float CELLS_PER_BALL = 4.0f;                 // caps the grid size when the balls are tiny
+constexpr unsigned long long BALL_SORT_INTERVAL = 32;  // ticks between putting the balls back in grid order
+constexpr int MAX_BOUNCES = 4;                         // per ball per tick, anything left after that just moves
+
+void reset_game(GameState& state, size_t ball_count, float ball_scale)
+{
+    bool log_collisions = state.log_collisions;
+    state.status = RUNNING;
+    state.winner = NO_WINNER;
+    state.tick = 0;
+    state.blue_score = 0;
+    state.pink_score = 0;
+    state.player_two = true;
+    state.log_collisions = log_collisions;
+
+    state.paddles.clear();
+    state.paddles.add(3.5f, 0.0f, PADDLE_SCALE, PADDLE_SCALE, SPRITE_BLUE);
+    state.paddles.add(-3.5f, 0.0f, PADDLE_SCALE, PADDLE_SCALE, SPRITE_PINK);
+    state.paddles.speed[BLUE] = PADDLE_SPEED;
+    state.paddles.speed[PINK] = PADDLE_SPEED;
+    state.paddles.movement_y[BLUE] = 1.0f;
+
+    state.balls.clear();
+    state.balls.reserve(ball_count);
+    state.ball_scale = ball_scale;
+
+    // Cells at least one ball across, and no more cells than balls, or clearing and scanning
+    // mostly empty cells costs more than the collisions. One cell of slack around the field
+    // catches balls on their way out.
+    float field_area = (2.0f * FIELD_HALF_WIDTH) * (2.0f * FIELD_HALF_HEIGHT);
+    float cell_size = std::max(2.0f * ball_scale * BALL_RADIUS, std::sqrt(field_area / (CELLS_PER_BALL * std::max(ball_count, (size_t)1))));
+    state.grid.configure(-FIELD_HALF_WIDTH - cell_size, -FIELD_HALF_HEIGHT - cell_size,
+                         FIELD_HALF_WIDTH + cell_size, FIELD_HALF_HEIGHT + cell_size, cell_size);
+
+    // the ball starts one movement step in from (-2, -2), same as it always has
+    if (ball_count > 0) add_ball(state, -1.0f, -1.0f, 1.0f, 1.0f);
+
+    // extra balls get a cheap deterministic scatter so runs are reproducible
+    unsigned int hash = 2166136261u;
+    for (size_t i = 1; i < ball_count; i++)
+    {
+        hash = (hash ^ (unsigned int)i) * 16777619u;
+        float x = ((hash & 0xffff) / 65535.0f - 0.5f) * 4.0f;
+        float y = (((hash >> 16) & 0xffff) / 65535.0f - 0.5f) * (FIELD_HALF_HEIGHT * 1.6f);
+        add_ball(state, x, y, (hash & 1) ? 1.0f : -1.0f, (hash & 2) ? 1.0f : -1.0f);
+    }
+}
+
+size_t add_ball(GameState& state, float x, float y, float movement_x, float movement_y)
+{
+    size_t index = state.balls.add(x, y, state.ball_scale, state.ball_scale, SPRITE_BALL);
+    state.balls.movement_x[index] = movement_x;
+    state.balls.movement_y[index] = movement_y;
+    state.balls.speed[index] = BALL_SPEED;
+    state.balls.spin[index] = -1.0f;
+    return index;
+}
+
+void apply_input(GameState& state, const InputState& input)
+{
+    EntityStore& paddles = state.paddles;
+
+    if (input.quit)
+    {
+        state.status = TERMINATED;
+    }
+
+    if (input.toggle_player_two)
+    {
+        state.player_two = !state.player_two;
+        if (!state.player_two)
+        {
+            paddles.movement_y[BLUE] = 1.0f;
+        }
+    }
+
+    // VERY IMPORTANT: If nothing is pressed, we don't want to go anywhere
+    paddles.movement_x[PINK] = 0.0f;
+    paddles.movement_y[PINK] = input.pink_direction;
+    if (state.player_two)
+    {
+        paddles.movement_x[BLUE] = 0.0f;
+        paddles.movement_y[BLUE] = input.blue_direction;
+    }
+}
+
+// Add direction * units per second * elapsed time, for every entity in the store
+static void integrate(EntityStore& store, float delta_time)
+{
+    const size_t count = store.size();
+    float* position_x = store.position_x.data();
+    float* position_y = store.position_y.data();
+    const float* movement_x = store.movement_x.data();
+    const float* movement_y = store.movement_y.data();
+    const float* speed = store.speed.data();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        position_x[i] += movement_x[i] * speed[i] * delta_time;
+        position_y[i] += movement_y[i] * speed[i] * delta_time;
+    }
+}
+
+// Equal-mass elastic ball - ball collisions. Each ball only looks at its neighbours in the grid
+// and only writes its own results, so the balls can be split over threads freely.
+static void collide_balls(GameState& state)
+{
+    EntityStore& balls = state.balls;
+    ContactBuffer& contacts = state.contacts;
+    SpatialGrid& grid = state.grid;
+    const size_t count = balls.size();
+
+    grid.build(balls.position_x.data(), balls.position_y.data(), count);
+
+    contacts.sorted_x.resize(count);
+    contacts.sorted_y.resize(count);
+    contacts.sorted_velocity_x.resize(count);
+    contacts.sorted_velocity_y.resize(count);
+    contacts.sorted_speed.resize(count);
+    contacts.ball_movement_x.resize(count);
+    contacts.ball_movement_y.resize(count);
+    contacts.ball_push_x.resize(count);
+    contacts.ball_push_y.resize(count);
+
+    // copy everything into cell order once, so the neighbour scans below read memory in sequence
+    const uint32_t* sorted = grid.sorted();
+    for (size_t k = 0; k < count; k++)
+    {
+        uint32_t i = sorted[k];
+        contacts.sorted_x[k] = balls.position_x[i];
+        contacts.sorted_y[k] = balls.position_y[i];
+        contacts.sorted_velocity_x[k] = balls.movement_x[i] * balls.speed[i];
+        contacts.sorted_velocity_y[k] = balls.movement_y[i] * balls.speed[i];
+        contacts.sorted_speed[k] = balls.speed[i];
+    }
+
+    const float diameter = 2.0f * state.ball_scale * BALL_RADIUS;
+    const float diameter_squared = diameter * diameter;
+    const float* x = contacts.sorted_x.data();
+    const float* y = contacts.sorted_y.data();
+    const float* velocity_x = contacts.sorted_velocity_x.data();
+    const float* velocity_y = contacts.sorted_velocity_y.data();
+    const uint32_t* cell_start = grid.cell_start();
+    const float* speed = contacts.sorted_speed.data();
+    const int columns = grid.columns(), rows = grid.rows();
+
+    auto resolve = [&](size_t begin, size_t end)
+    {
+        for (size_t k = begin; k < end; k++)
+        {
+            float impulse_x = 0.0f, impulse_y = 0.0f;
+            float push_x = 0.0f, push_y = 0.0f;
+            int impulses = 0;
+
+            uint32_t cell = grid.cell_of(x[k], y[k]);
+            int column = (int)(cell % columns), row = (int)(cell / columns);
+            int first_column = column > 0 ? column - 1 : 0;
+            int last_column = column < columns - 1 ? column + 1 : columns - 1;
+
+            for (int r = row - 1; r <= row + 1; r++)
+            {
+                if (r < 0 || r >= rows) continue;
+
+                // the neighbouring cells of one row sit back to back in the sorted order
+                uint32_t first = cell_start[r * columns + first_column];
+                uint32_t last = cell_start[r * columns + last_column + 1];
+                for (uint32_t m = first; m < last; m++)
+                {
+                    if (m == k) continue;
+
+                    float dx = x[k] - x[m];
+                    float dy = y[k] - y[m];
+                    float distance_squared = dx * dx + dy * dy;
+                    if (distance_squared >= diameter_squared || distance_squared == 0.0f) continue;
+
+                    float distance = sqrtf(distance_squared);
+                    float normal_x = dx / distance, normal_y = dy / distance;
+
+                    // each ball moves half the overlap, the other one does its half on its own turn
+                    push_x += normal_x * (diameter - distance) * 0.5f;
+                    push_y += normal_y * (diameter - distance) * 0.5f;
+
+                    // equal masses just trade their velocities along the normal
+                    float approach = (velocity_x[k] - velocity_x[m]) * normal_x + (velocity_y[k] - velocity_y[m]) * normal_y;
+                    if (approach < 0.0f)
+                    {
+                        impulse_x -= approach * normal_x;
+                        impulse_y -= approach * normal_y;
+                        impulses++;
+                    }
+                }
+            }
+
+            // Every pair was worked out from the old velocities, so a ball wedged between several
+            // others would get all their kicks at once and gain energy. Averaging them keeps a
+            // lone pair exact and stops clusters from blowing up.
+            if (impulses > 1)
+            {
+                impulse_x /= (float)impulses;
+                impulse_y /= (float)impulses;
+            }
+
+            float inverse_speed = speed[k] > 0.0f ? 1.0f / speed[k] : 0.0f;
+            contacts.ball_movement_x[k] = (velocity_x[k] + impulse_x) * inverse_speed;
+            contacts.ball_movement_y[k] = (velocity_y[k] + impulse_y) * inverse_speed;
+            contacts.ball_push_x[k] = push_x;
+            contacts.ball_push_y[k] = push_y;
+        }
+    };
+
+    if (state.workers) state.workers->parallel_for(count, resolve);
+    else resolve(0, count);
+
+    for (size_t k = 0; k < count; k++)
+    {
+        uint32_t i = sorted[k];
+        balls.movement_x[i] = contacts.ball_movement_x[k];
+        balls.movement_y[i] = contacts.ball_movement_y[k];
+        balls.position_x[i] += contacts.ball_push_x[k];
+        balls.position_y[i] += contacts.ball_push_y[k];
+    }
+
+    // Every so often put the store itself in grid order. Balls that are close on the field
+    // then sit close in memory, and the gathers and scatters above stay cache friendly.
+    if (state.tick % BALL_SORT_INTERVAL == 0)
+    {
+        balls.reorder(sorted);
+    }
+}
+
+// Moves every ball through its whole tick. Each one stops at the first paddle or wall it would
+// touch on the way, bounces, and carries on with the time it has left, so fast balls and long
+// ticks can't tunnel through anything.
+static void sweep_balls(GameState& state, const float* box_x, const float* box_y,
+                        const float* box_half_width, const float* box_half_height, size_t box_count, float delta_time)
+{
+    EntityStore& balls = state.balls;
+    const float radius = state.ball_scale * BALL_RADIUS;
+    const float wall_radius = state.ball_scale * BALL_WALL_RADIUS;
+
+    for (size_t i = 0; i < balls.size(); i++)
+    {
+        float x = balls.position_x[i], y = balls.position_y[i];
+        float velocity_x = balls.movement_x[i] * balls.speed[i];
+        float velocity_y = balls.movement_y[i] * balls.speed[i];
+        float remaining = delta_time;
+
+        for (int bounce = 0; bounce <= MAX_BOUNCES && remaining > 0.0f; bounce++)
+        {
+            float first = remaining;
+            float normal_x = 0.0f, normal_y = 0.0f;
+            bool paddle = false;
+
+            // walls
+            if (velocity_y > 0.0f)
+            {
+                float t = (FIELD_HALF_HEIGHT - wall_radius - y) / velocity_y;
+                if (t >= 0.0f && t < first) { first = t; normal_x = 0.0f; normal_y = -1.0f; paddle = false; }
+            }
+            else if (velocity_y < 0.0f)
+            {
+                float t = (-FIELD_HALF_HEIGHT + wall_radius - y) / velocity_y;
+                if (t >= 0.0f && t < first) { first = t; normal_x = 0.0f; normal_y = 1.0f; paddle = false; }
+            }
+
+            // paddles
+            for (size_t j = 0; j < box_count; j++)
+            {
+                float t, nx, ny;
+                if (sweep_circle_box(x, y, velocity_x, velocity_y, radius, box_x[j], box_y[j],
+                                     box_half_width[j], box_half_height[j], first, t, nx, ny) && t < first)
+                {
+                    first = t;
+                    normal_x = nx;
+                    normal_y = ny;
+                    paddle = true;
+                }
+            }
+
+            x += velocity_x * first;
+            y += velocity_y * first;
+            remaining -= first;
+
+            // nothing in the way, or out of bounces
+            if ((normal_x == 0.0f && normal_y == 0.0f) || bounce == MAX_BOUNCES) break;
+
+            float approach = velocity_x * normal_x + velocity_y * normal_y;
+            velocity_x -= 2.0f * approach * normal_x;
+            velocity_y -= 2.0f * approach * normal_y;
+            balls.hit[i] = 1;
+
+            if (paddle)
+            {
+                if (state.log_collisions) std::cout << std::time(nullptr) << ": Collision.\n";
+                balls.spin[i] *= -1.0f;
+            }
+        }
+
+        // anything left after the last bounce still gets travelled, just unchecked
+        x += velocity_x * remaining;
+        y += velocity_y * remaining;
+
+        balls.position_x[i] = x;
+        balls.position_y[i] = y;
+        float inverse_speed = balls.speed[i] > 0.0f ? 1.0f / balls.speed[i] : 0.0f;
+        balls.movement_x[i] = velocity_x * inverse_speed;
+        balls.movement_y[i] = velocity_y * inverse_speed;
+    }
+}
+
+void step(GameState& state, float delta_time)
+{
+    EntityStore& paddles = state.paddles;
+    EntityStore& balls = state.balls;
+
+    paddles.save_previous();
+    balls.save_previous();
+    state.tick++;
+
+    integrate(paddles, delta_time);
+
+    // paddle hitboxes, as of after this tick's paddle movement
+    float box_x[MAX_COLLISION_BOXES], box_y[MAX_COLLISION_BOXES];
+    float box_half_width[MAX_COLLISION_BOXES], box_half_height[MAX_COLLISION_BOXES];
+    for (size_t j = 0; j < paddles.size(); j++)
+    {
+        float facing = paddles.position_x[j] > 0.0f ? -1.0f : 1.0f;  // which way the field is
+        box_x[j] = paddles.position_x[j] + facing * paddles.scale_x[j] * PADDLE_FACE_OFFSET;
+        box_y[j] = paddles.position_y[j];
+        box_half_width[j] = paddles.scale_x[j] * PADDLE_HITBOX_HALF_WIDTH;
+        box_half_height[j] = paddles.scale_y[j] * PADDLE_HITBOX_HALF_HEIGHT;
+    }
+
+    for (size_t i = 0; i < balls.size(); i++)
+    {
+        if (balls.hit[i] && balls.hit_time[i] < HIT_RECOVERY)
+        {
+            balls.hit_time[i] += delta_time;
+        }
+        else if (balls.hit[i] && balls.hit_time[i] >= HIT_RECOVERY)
+        {
+            balls.hit_time[i] = 0.0f;
+            balls.hit[i] = 0;
+        }
+
+        balls.rotation[i] += 1.0f * delta_time;
+    }
+
+    sweep_balls(state, box_x, box_y, box_half_width, box_half_height, paddles.size(), delta_time);
+
+    // ball - ball collision
+    if (balls.size() > 1) collide_balls(state);
+
+    // Whatever still overlaps a paddle got there by the paddle moving into it, or by another
+    // ball shoving it. Test everything in one batch and push those out.
+    ContactBuffer& contacts = state.contacts;
+    contacts.hit_mask.resize(balls.size());
+    contacts.normal_x.resize(balls.size());
+    contacts.normal_y.resize(balls.size());
+    contacts.depth.resize(balls.size());
+
+    collide_circles_boxes(balls.position_x.data(), balls.position_y.data(), balls.size(), state.ball_scale * BALL_RADIUS,
+                          box_x, box_y, box_half_width, box_half_height, paddles.size(),
+                          contacts.hit_mask.data(), contacts.normal_x.data(), contacts.normal_y.data(), contacts.depth.data());
+
+    for (size_t i = 0; i < balls.size(); i++)
+    {
+        float& ball_x = balls.position_x[i];
+        float& ball_y = balls.position_y[i];
+
+        if (contacts.hit_mask[i])
+        {
+            float normal_x = contacts.normal_x[i], normal_y = contacts.normal_y[i];
+
+            // bounce off the paddle, unless we're already heading away from it
+            float approach = balls.movement_x[i] * normal_x + balls.movement_y[i] * normal_y;
+            if (approach < 0.0f)
+            {
+                if (state.log_collisions) std::cout << std::time(nullptr) << ": Collision.\n";
+                balls.movement_x[i] -= 2.0f * approach * normal_x;
+                balls.movement_y[i] -= 2.0f * approach * normal_y;
+                balls.spin[i] *= -1.0f;
+            }
+
+            // and move out so we don't register the same hit next tick
+            balls.hit[i] = 1;
+            ball_x += normal_x * contacts.depth[i];
+            ball_y += normal_y * contacts.depth[i];
+        }
+        // same for the walls, clamp back inside and make sure we're heading away
+        const float wall_radius = state.ball_scale * BALL_WALL_RADIUS;
+        if (ball_y + wall_radius > FIELD_HALF_HEIGHT)
+        {
+            balls.hit[i] = 1;
+            ball_y = FIELD_HALF_HEIGHT - wall_radius;
+            if (balls.movement_y[i] > 0.0f) balls.movement_y[i] *= -1.0f;
+        } else if (ball_y - wall_radius < -FIELD_HALF_HEIGHT) {
+            balls.hit[i] = 1;
+            ball_y = -FIELD_HALF_HEIGHT + wall_radius;
+            if (balls.movement_y[i] < 0.0f) balls.movement_y[i] *= -1.0f;
+        }
+
+        balls.sprite[i] = balls.hit[i] ? SPRITE_HIT : SPRITE_BALL;
+    }
+
+    // ball out the right side is a point for pink, out the left is a point for blue
+    for (size_t i = 0; i < balls.size(); )
+    {
+        bool out_right = balls.position_x[i] - state.ball_scale/2.0 >= FIELD_HALF_WIDTH;
+        bool out_left = balls.position_x[i] + state.ball_scale/2.0 <= -FIELD_HALF_WIDTH;
+        if (!out_right && !out_left)
+        {
+            i++;
+            continue;
+        }
+
+        if (out_right) state.pink_score++;
+        else state.blue_score++;
+
+        balls.remove(i);
+    }
+
+    // the match is over once every ball has gone out
+    if (balls.size() == 0)
+    {
+        if (state.blue_score > state.pink_score) state.winner = BLUE_WINS;
+        else if (state.pink_score > state.blue_score) state.winner = PINK_WINS;
+        state.status = TERMINATED;
+    }
+
+    // blue - wall collision
+    if (paddles.position_y[BLUE] + PADDLE_SCALE/3.0 >= FIELD_HALF_HEIGHT)
+    {
+        paddles.position_y[BLUE] -= 0.1f;
+        paddles.movement_y[BLUE] *= -1.0f;
+    } else if (paddles.position_y[BLUE] - PADDLE_SCALE/3.0 <= -FIELD_HALF_HEIGHT) {
+        paddles.position_y[BLUE] += 0.1f;
+        paddles.movement_y[BLUE] *= -1.0f;
+    }
+    // pink - wall collision
+    if (paddles.position_y[PINK] + PADDLE_SCALE/2.4 >= FIELD_HALF_HEIGHT)
+    {
+        paddles.position_y[PINK] -= 0.1f;
+        paddles.movement_y[PINK] *= -1.0f;
+    } else if (paddles.position_y[PINK] - PADDLE_SCALE/2.4 <= -FIELD_HALF_HEIGHT) {
+        paddles.position_y[PINK] += 0.1f;
+        paddles.movement_y[PINK] *= -1.0f;
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "EntityStore.h"
+#include "SpatialGrid.h"
+#include <cstdint>
+#include <vector>
+
+// Everything in here is plain game logic, no SDL or GL, so it can run without a window.
+
+enum AppStatus { RUNNING, TERMINATED };
+enum Winner { NO_WINNER, BLUE_WINS, PINK_WINS };
+
+constexpr float FIXED_TIMESTEP = 1.0f / 120.0f;  // physics runs at 120 Hz no matter the frame rate
+
+constexpr float PADDLE_SCALE = 2.5f,
+BALL_SCALE = 1.0f;
+
+constexpr float FIELD_HALF_WIDTH = 5.0f,
+FIELD_HALF_HEIGHT = 3.75f;
+
+constexpr float PADDLE_SPEED = 2.4f,  // move 2.4 units per second
+BALL_SPEED = 1.0f;                    // move 1 unit per second
+
+// Collision shapes, as fractions of the sprite scale. The paddle box only covers the strip of the
+// sprite facing the field, the rest of the picture is just the character.
+constexpr float PADDLE_FACE_OFFSET = 1.0f / 3.0f,
+PADDLE_HITBOX_HALF_WIDTH = 1.0f / 24.0f,
+PADDLE_HITBOX_HALF_HEIGHT = 0.4f,
+BALL_RADIUS = 0.3f,
+BALL_WALL_RADIUS = 1.0f / 2.4f;  // the walls have always let the ball sink in a bit less
+
+constexpr float HIT_RECOVERY = 3.0f;  // seconds the ball shows its hit sprite
+
+// paddles always sit at these indices in GameState::paddles
+constexpr size_t BLUE = 0,
+PINK = 1;
+
+// What the players asked for during one tick. Directions are -1, 0 or 1, the flags are one-shot.
+struct InputState
+{
+    float pink_direction = 0.0f;
+    float blue_direction = 0.0f;
+    bool toggle_player_two = false;
+    bool quit = false;
+};
+
+class WorkerPool;
+
+// Per-ball collision results, refilled every tick
+struct ContactBuffer
+{
+    // ball - paddle
+    std::vector<uint32_t> hit_mask;
+    std::vector<float> normal_x, normal_y, depth;
+
+    // ball - ball, all in grid order and worked out for every ball before any of them are changed
+    std::vector<float> sorted_x, sorted_y, sorted_velocity_x, sorted_velocity_y, sorted_speed;
+    std::vector<float> ball_movement_x, ball_movement_y;
+    std::vector<float> ball_push_x, ball_push_y;
+};
+
+struct GameState
+{
+    AppStatus status = RUNNING;
+    Winner winner = NO_WINNER;
+    unsigned long long tick = 0;
+
+    EntityStore paddles;
+    EntityStore balls;
+    float ball_scale = BALL_SCALE;
+
+    SpatialGrid grid;
+    ContactBuffer contacts;
+    WorkerPool* workers = nullptr;  // spreads ball - ball collisions over threads when set, not owned
+
+    int blue_score = 0;
+    int pink_score = 0;
+
+    bool player_two = true;
+    bool log_collisions = true;  // the headless runner turns this off, it would flood stdout
+};
+
+// Sets up a fresh match. The first ball gets the classic serve, any extras are spread over the field.
+void reset_game(GameState& state, size_t ball_count = 1, float ball_scale = BALL_SCALE);
+size_t add_ball(GameState& state, float x, float y, float movement_x, float movement_y);
+void apply_input(GameState& state, const InputState& input);
+void step(GameState& state, float delta_time);
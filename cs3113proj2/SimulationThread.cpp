@@ -0,0 +1,121 @@
+#include "SimulationThread.h"
+#include "Profiler.h"
+#include <chrono>
+
+double SimulationThread::now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SimulationThread::start(size_t ball_count, float ball_scale)
+{
+    if (m_playback != nullptr) m_playback->restart(m_state);
+    else reset_game(m_state, ball_count, ball_scale);
+    if (m_record_path != nullptr) m_recording.begin(m_state);
+
+    m_stopping = false;
+    publish(now());
+    m_thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop()
+{
+    m_stopping = true;
+    if (m_thread.joinable()) m_thread.join();
+}
+
+const RenderSnapshot& SimulationThread::latest_snapshot()
+{
+    m_snapshots.update();
+    return m_snapshots.read_buffer();
+}
+
+void SimulationThread::publish(double time)
+{
+    RenderSnapshot& snapshot = m_snapshots.write_buffer();
+
+    // plain assignment reuses the vectors' storage, so after the first few ticks this doesn't allocate
+    snapshot.paddles = m_state.paddles;
+    snapshot.balls = m_state.balls;
+    snapshot.status = m_state.status;
+    snapshot.winner = m_state.winner;
+    snapshot.time = time;
+    snapshot.tick_length = FIXED_TIMESTEP / (m_playback != nullptr ? m_playback_speed : 1.0);
+
+    m_snapshots.publish();
+}
+
+void SimulationThread::run()
+{
+    double previous_time = now();
+    double accumulator = 0.0;
+    const double speed = m_playback != nullptr ? m_playback_speed : 1.0;  // game seconds per real second
+
+    while (!m_stopping && m_state.status == RUNNING)
+    {
+        // take everything the render thread has sent, directions are latest wins, one-shots add up
+        InputState queued;
+        while (m_inputs.try_pop(queued))
+        {
+            m_input.pink_direction = queued.pink_direction;
+            m_input.blue_direction = queued.blue_direction;
+            m_input.toggle_player_two = m_input.toggle_player_two != queued.toggle_player_two;
+            m_input.quit = m_input.quit || queued.quit;
+        }
+
+        double time = now();
+        double delta_time = time - previous_time;
+        previous_time = time;
+
+        if (delta_time > MAX_FRAME_TIME) delta_time = MAX_FRAME_TIME;
+        accumulator += delta_time * speed;
+
+        // quitting shouldn't have to wait for a full tick to build up
+        if (m_input.quit)
+        {
+            m_state.status = TERMINATED;
+            publish(time);
+            break;
+        }
+
+        bool stepped = false;
+        while (accumulator >= FIXED_TIMESTEP && m_state.status == RUNNING)
+        {
+            // a replay only takes quit from the keyboard, everything else is what was recorded
+            if (m_playback != nullptr && m_state.tick >= m_playback->tick_count)
+            {
+                m_state.status = TERMINATED;
+                break;
+            }
+            InputState input = m_playback != nullptr ? m_playback->input_at(m_state.tick) : m_input;
+            m_input.toggle_player_two = false;
+
+            apply_input(m_state, input);
+            if (m_record_path != nullptr) m_recording.record(input);
+
+            {
+                PROFILE_SCOPE("tick");
+                step(m_state, FIXED_TIMESTEP);
+            }
+            accumulator -= FIXED_TIMESTEP;
+            stepped = true;
+        }
+
+        // stamp it with when the newest tick became due, render() blends into it over the next tick
+        if (stepped || m_state.status != RUNNING)
+        {
+            PROFILE_SCOPE("publish");
+            publish(time - accumulator / speed);
+        }
+
+        // nothing to do until the next tick is due
+        double wait = (FIXED_TIMESTEP - accumulator) / speed;
+        if (wait > 0.0) std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+    }
+
+    if (m_record_path != nullptr)
+    {
+        m_recording.finish(m_state);
+        m_recording.save(m_record_path);
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Replay.h"
+#include "Simulation.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+#include <atomic>
+#include <thread>
+
+constexpr float MAX_FRAME_TIME = 0.25f;  // clamp long stalls so we don't spiral trying to catch up
+constexpr size_t INPUT_QUEUE_SIZE = 64;
+
+/**
+ Everything render() needs from one simulation tick. The stores are copied wholesale, so the
+ render thread can interpolate between previous and current without touching the live state.
+ */
+struct RenderSnapshot
+{
+    EntityStore paddles;
+    EntityStore balls;
+    AppStatus status = RUNNING;
+    Winner winner = NO_WINNER;
+    double time = 0.0;          // SimulationThread::now() when this tick became due, previous -> current blends from here
+    double tick_length = FIXED_TIMESTEP;  // real seconds per tick, shorter when fast-forwarding a replay
+};
+
+/**
+ Runs step() on its own thread at FIXED_TIMESTEP, in real time. Input comes in through an
+ SPSC queue and finished ticks go out through a triple buffer, so a slow swap on the render
+ side never holds up physics and a long tick never holds up a frame.
+ */
+class SimulationThread
+{
+public:
+    SimulationThread() = default;
+    ~SimulationThread() { stop(); }
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    void start(size_t ball_count, float ball_scale = BALL_SCALE);
+    void stop();
+
+    // Call before start(). Records every tick and writes the replay out when the match ends.
+    void record(const char* path) { m_record_path = path; }
+    // Call before start(). Ticks come from the replay instead of the input queue, speed times real time.
+    void play(const Replay& replay, float speed) { m_playback = &replay; m_playback_speed = speed; }
+
+    // Render thread side. Returns false if the queue is full, try again next frame.
+    bool push_input(const InputState& input) { return m_inputs.try_push(input); }
+
+    // Render thread side. The snapshot stays valid until the next call.
+    const RenderSnapshot& latest_snapshot();
+
+    static double now();
+
+private:
+    void run();
+    void publish(double time);
+
+    GameState m_state;
+    InputState m_input;  // latest directions plus any one-shot flags not yet consumed by a tick
+    Replay m_recording;
+    const char* m_record_path = nullptr;
+    const Replay* m_playback = nullptr;
+    float m_playback_speed = 1.0f;
+    SpscQueue<InputState, INPUT_QUEUE_SIZE> m_inputs;
+    TripleBuffer<RenderSnapshot> m_snapshots;
+    std::thread m_thread;
+    std::atomic<bool> m_stopping{ false };
+};
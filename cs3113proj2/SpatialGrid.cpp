@@ -0,0 +1,55 @@
+#include "SpatialGrid.h"
+#include <algorithm>
+#include <cmath>
+
+void SpatialGrid::configure(float min_x, float min_y, float max_x, float max_y, float cell_size)
+{
+    m_min_x = min_x;
+    m_min_y = min_y;
+    m_inverse_cell_size = 1.0f / cell_size;
+    m_columns = std::max(1, (int)std::ceil((max_x - min_x) * m_inverse_cell_size));
+    m_rows = std::max(1, (int)std::ceil((max_y - min_y) * m_inverse_cell_size));
+
+    m_cell_start.assign((size_t)m_columns * m_rows + 1, 0);
+    m_entity_cell.clear();
+    m_sorted.clear();
+}
+
+uint32_t SpatialGrid::cell_of(float x, float y) const
+{
+    int column = (int)((x - m_min_x) * m_inverse_cell_size);
+    int row = (int)((y - m_min_y) * m_inverse_cell_size);
+    column = std::min(std::max(column, 0), m_columns - 1);
+    row = std::min(std::max(row, 0), m_rows - 1);
+    return (uint32_t)(row * m_columns + column);
+}
+
+void SpatialGrid::build(const float* x, const float* y, size_t count)
+{
+    const size_t cell_count = (size_t)m_columns * m_rows;
+    m_entity_cell.resize(count);
+    m_sorted.resize(count);
+    std::fill(m_cell_start.begin(), m_cell_start.end(), 0);
+
+    // count how many land in each cell...
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t cell = cell_of(x[i], y[i]);
+        m_entity_cell[i] = cell;
+        m_cell_start[cell]++;
+    }
+
+    // ...turn the counts into where each cell ends...
+    for (size_t c = 1; c < cell_count; c++)
+    {
+        m_cell_start[c] += m_cell_start[c - 1];
+    }
+    m_cell_start[cell_count] = (uint32_t)count;
+
+    // ...and drop everyone into place from the back, which leaves each entry pointing at its
+    // cell's start and keeps each cell in index order
+    for (size_t i = count; i-- > 0; )
+    {
+        m_sorted[--m_cell_start[m_entity_cell[i]]] = (uint32_t)i;
+    }
+}
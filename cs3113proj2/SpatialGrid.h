@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ Uniform grid broadphase for ball - ball collisions.
+
+ build() buckets every entity by cell with a counting sort, so each cell's entities end up
+ next to each other in sorted(), and the three cells of a grid row are one contiguous range.
+ Anything outside the bounds is clamped into the edge cells. With the cell size at least one
+ ball diameter, any two balls that can touch are in the same or neighbouring cells.
+ */
+class SpatialGrid
+{
+public:
+    void configure(float min_x, float min_y, float max_x, float max_y, float cell_size);
+    void build(const float* x, const float* y, size_t count);
+
+    size_t size() const { return m_sorted.size(); }
+    int columns() const { return m_columns; }
+    int rows() const { return m_rows; }
+
+    uint32_t cell_of(float x, float y) const;
+    uint32_t entity_cell(size_t index) const { return m_entity_cell[index]; }
+
+    // entity indices ordered by cell, cell c owns sorted()[cell_start()[c] .. cell_start()[c + 1])
+    const uint32_t* sorted() const { return m_sorted.data(); }
+    const uint32_t* cell_start() const { return m_cell_start.data(); }
+
+private:
+    float m_min_x = 0.0f, m_min_y = 0.0f;
+    float m_inverse_cell_size = 1.0f;
+    int m_columns = 0, m_rows = 0;
+
+    std::vector<uint32_t> m_cell_start;   // one past the end holds the total
+    std::vector<uint32_t> m_entity_cell;
+    std::vector<uint32_t> m_sorted;
+};
@@ -0,0 +1,90 @@
+#define GL_SILENCE_DEPRECATION
+
+#include "SpriteBatch.h"
+#include <cstddef>
+
+constexpr GLsizei QUAD_VERTEX_COUNT = 4;  // triangle strip
+constexpr GLsizei QUAD_STRIDE = 4 * sizeof(float);
+
+// per-instance attribute, advancing once per sprite instead of once per vertex
+static void instance_attribute(const ShaderProgram& program, const char* name, GLint size, GLenum type, GLboolean normalised, size_t offset)
+{
+    GLint location = program.get_attribute_location(name);
+    if (location < 0) return;  // compiled out of the shader
+
+    glVertexAttribPointer(location, size, type, normalised, sizeof(SpriteInstance), (void*)offset);
+    glVertexAttribDivisor(location, 1);
+    glEnableVertexAttribArray(location);
+}
+
+void SpriteBatch::initialise(const ShaderProgram& program, GLuint quad_buffer)
+{
+    m_instances.reserve(MAX_INSTANCES);
+
+    glGenVertexArrays(1, &m_vao);
+    GLState::bind_vertex_array(m_vao);
+
+    // the quad, shared by every instance
+    GLState::bind_array_buffer(quad_buffer);
+    glVertexAttribPointer(program.get_position_attribute(), 2, GL_FLOAT, false, QUAD_STRIDE, (void*)0);
+    glEnableVertexAttribArray(program.get_position_attribute());
+    glVertexAttribPointer(program.get_tex_coordinate_attribute(), 2, GL_FLOAT, false, QUAD_STRIDE, (void*)(2 * sizeof(float)));
+    glEnableVertexAttribArray(program.get_tex_coordinate_attribute());
+
+    // and the sprites, refilled every flush
+    glGenBuffers(1, &m_instance_buffer);
+    GLState::bind_array_buffer(m_instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, MAX_INSTANCES * sizeof(SpriteInstance), NULL, GL_STREAM_DRAW);
+
+    instance_attribute(program, "instancePosition", 2, GL_FLOAT, GL_FALSE, offsetof(SpriteInstance, x));
+    instance_attribute(program, "instanceAxes", 4, GL_FLOAT, GL_FALSE, offsetof(SpriteInstance, axis_x_x));
+    instance_attribute(program, "instanceUvRect", 4, GL_FLOAT, GL_FALSE, offsetof(SpriteInstance, u0));
+    instance_attribute(program, "instanceTint", 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(SpriteInstance, red));
+
+    GLState::bind_vertex_array(0);
+}
+
+void SpriteBatch::shutdown()
+{
+    glDeleteBuffers(1, &m_instance_buffer);
+    glDeleteVertexArrays(1, &m_vao);
+    GLState::invalidate();
+}
+
+void SpriteBatch::begin()
+{
+    m_instances.clear();
+    m_texture = 0;
+    m_draw_calls = 0;
+}
+
+void SpriteBatch::add(GLuint texture, const SpriteInstance& instance)
+{
+    if ((texture != m_texture && !m_instances.empty()) || m_instances.size() == MAX_INSTANCES) flush();
+
+    m_texture = texture;
+    m_instances.push_back(instance);
+}
+
+void SpriteBatch::end()
+{
+    flush();
+}
+
+void SpriteBatch::flush()
+{
+    if (m_instances.empty()) return;
+
+    GLState::bind_vertex_array(m_vao);
+    GLState::bind_array_buffer(m_instance_buffer);
+
+    // orphan the old storage first so we never wait on a draw that's still reading it
+    glBufferData(GL_ARRAY_BUFFER, MAX_INSTANCES * sizeof(SpriteInstance), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, m_instances.size() * sizeof(SpriteInstance), m_instances.data());
+
+    GLState::bind_texture(m_texture);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, QUAD_VERTEX_COUNT, (GLsizei)m_instances.size());
+
+    m_instances.clear();
+    m_draw_calls++;
+}
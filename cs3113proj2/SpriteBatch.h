@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ShaderProgram.h"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/**
+ What the instanced shader needs to place one sprite. Laid out exactly as it goes into the
+ instance buffer.
+ */
+struct SpriteInstance
+{
+    float x, y;
+    float axis_x_x, axis_x_y;        // the sprite's scaled and rotated x and y axes, see place()
+    float axis_y_x, axis_y_y;
+    float u0, v0, u1, v1;            // the part of the texture to show, 0..1
+    uint8_t red, green, blue, alpha; // multiplied into the texture colour
+
+    // Rotation is done here rather than in the shader, sin and cos per vertex is most of
+    // the vertex cost on a software rasteriser
+    void place(float position_x, float position_y, float scale_x, float scale_y, float rotation)
+    {
+        float c = cosf(rotation), s = sinf(rotation);
+        x = position_x;
+        y = position_y;
+        axis_x_x = c * scale_x;
+        axis_x_y = s * scale_x;
+        axis_y_x = -s * scale_y;
+        axis_y_y = c * scale_y;
+    }
+};
+
+/**
+ Collects sprites for a frame and draws them with glDrawArraysInstanced instead of one draw
+ call each. Everything sharing a texture in a row goes out in a single draw, a texture change
+ or a full buffer flushes what's there so far.
+ */
+class SpriteBatch
+{
+public:
+    static constexpr size_t MAX_INSTANCES = 16384;  // per draw, bigger frames just flush more than once
+
+    // quad_buffer holds the unit quad as a 4 vertex triangle strip, interleaved position / texture coordinate
+    void initialise(const ShaderProgram& program, GLuint quad_buffer);
+    void shutdown();
+
+    void begin();
+    void add(GLuint texture, const SpriteInstance& instance);
+    void end();
+
+    unsigned int draw_calls() const { return m_draw_calls; }  // in the last begin() / end()
+
+private:
+    void flush();
+
+    GLuint m_vao = 0;
+    GLuint m_instance_buffer = 0;
+    GLuint m_texture = 0;
+    std::vector<SpriteInstance> m_instances;
+    unsigned int m_draw_calls = 0;
+};
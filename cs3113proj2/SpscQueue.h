@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ Fixed-size ring for passing values from exactly one producer thread to exactly one consumer.
+ Neither side locks or allocates, a full queue just refuses the push.
+ CAPACITY has to be a power of two.
+ */
+template <typename T, size_t CAPACITY>
+class SpscQueue
+{
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    bool try_push(const T& value)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == CAPACITY) return false;
+
+        m_items[tail & (CAPACITY - 1)] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& value)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) return false;
+
+        value = m_items[head & (CAPACITY - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T m_items[CAPACITY];
+
+    // kept on separate cache lines so the two threads aren't fighting over one
+    alignas(64) std::atomic<size_t> m_head{ 0 };  // next slot to pop, written by the consumer
+    alignas(64) std::atomic<size_t> m_tail{ 0 };  // next slot to push, written by the producer
+};
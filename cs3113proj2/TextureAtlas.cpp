@@ -0,0 +1,65 @@
+#include "TextureAtlas.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#define LOG(argument) std::cout << argument << '\n'
+
+bool TextureAtlas::load(const char* manifest_path)
+{
+    std::ifstream manifest(manifest_path);
+    if (manifest.fail())
+    {
+        LOG("Unable to open atlas manifest " << manifest_path);
+        return false;
+    }
+
+    // the image is named relative to the manifest
+    std::string folder = manifest_path;
+    size_t slash = folder.find_last_of("/\\");
+    folder = slash == std::string::npos ? "" : folder.substr(0, slash + 1);
+
+    m_image_path.clear();
+    m_mip_levels = 0;
+    m_regions.clear();
+
+    float width = 0.0f, height = 0.0f;
+    std::string line;
+    while (std::getline(manifest, line))
+    {
+        std::istringstream fields(line);
+        std::string kind;
+        if (!(fields >> kind) || kind[0] == '#') continue;
+
+        if (kind == "atlas")
+        {
+            std::string image;
+            fields >> image >> width >> height;
+            m_image_path = folder + image;
+        }
+        else if (kind == "mip_levels")
+        {
+            fields >> m_mip_levels;
+        }
+        else if (kind == "sprite" && width > 0.0f && height > 0.0f)
+        {
+            std::string name;
+            float x, y, w, h;
+            if (!(fields >> name >> x >> y >> w >> h)) continue;
+            m_regions[name] = { x / width, y / height, (x + w) / width, (y + h) / height };
+        }
+    }
+
+    if (m_image_path.empty())
+    {
+        LOG("Atlas manifest " << manifest_path << " doesn't name an image");
+        return false;
+    }
+    return true;
+}
+
+const AtlasRegion* TextureAtlas::find(const std::string& name) const
+{
+    auto region = m_regions.find(name);
+    return region == m_regions.end() ? nullptr : &region->second;
+}
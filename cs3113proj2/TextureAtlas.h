@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+// Where one sprite sits in the atlas, in texture coordinates
+struct AtlasRegion
+{
+    float u0, v0, u1, v1;
+};
+
+/**
+ The manifest side of an atlas made by atlas_builder: the image to load, and a UV rect per
+ sprite name. Loading the image into GL is left to whoever owns the textures.
+ */
+class TextureAtlas
+{
+public:
+    bool load(const char* manifest_path);
+
+    const std::string& image_path() const { return m_image_path; }
+    int mip_levels() const { return m_mip_levels; }  // how far down the sprites are kept from bleeding together
+
+    // nullptr if the atlas has no sprite by that name
+    const AtlasRegion* find(const std::string& name) const;
+
+private:
+    std::string m_image_path;
+    int m_mip_levels = 0;
+    std::unordered_map<std::string, AtlasRegion> m_regions;
+};
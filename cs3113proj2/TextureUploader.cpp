@@ -0,0 +1,192 @@
+#define GL_SILENCE_DEPRECATION
+
+#include "TextureUploader.h"
+#include "Profiler.h"
+#include <cstring>
+#include <iostream>
+
+#define LOG(argument) std::cout << argument << '\n'
+
+constexpr GLbitfield STAGING_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+// true if the context is at least core_major.core_minor, or has the extension that added it before that
+static bool has_feature(GLint core_major, GLint core_minor, const char* extension)
+{
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > core_major || (major == core_major && minor >= core_minor)) return true;
+
+    GLint extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+    for (GLint i = 0; i < extensions; i++)
+    {
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), extension) == 0) return true;
+    }
+    return false;
+}
+
+bool TextureUploader::initialise(int slot_count, size_t slot_size)
+{
+    if (!has_feature(4, 4, "GL_ARB_buffer_storage"))
+    {
+        LOG("No persistent buffer mapping, textures upload straight from client memory");
+        return false;
+    }
+
+    // One buffer split into slots, rather than a buffer each, so there's only one mapping
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slot_size * slot_count, NULL, STAGING_FLAGS);
+    m_mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slot_size * slot_count, STAGING_FLAGS);
+    // left bound, every glTexImage2D elsewhere would read from it
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (m_mapped == nullptr)
+    {
+        LOG("Unable to map the texture staging buffer");
+        glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+        return false;
+    }
+
+    // immutable textures are a separate extension, 4.2 rather than 4.4
+    m_texture_storage = has_feature(4, 2, "GL_ARB_texture_storage");
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_slot_size = slot_size;
+    m_slots.assign(slot_count, Slot());
+    m_stopping = false;
+    return true;
+}
+
+void TextureUploader::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_slot_freed.notify_all();
+}
+
+void TextureUploader::shutdown()
+{
+    stop();
+    if (m_buffer == 0) return;
+
+    // the GPU may still be reading from the slots, so let it finish before the memory goes
+    for (Slot& slot : m_slots)
+    {
+        if (slot.fence == 0) continue;
+        glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        glDeleteTextures(1, &slot.texture);  // nobody polled for it, so nobody's drawing with it
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &m_buffer);
+    GLState::invalidate();
+    m_buffer = 0;
+    m_mapped = nullptr;
+}
+
+unsigned char* TextureUploader::acquire(size_t bytes, int& slot)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_mapped == nullptr || bytes > m_slot_size) return nullptr;
+
+    while (true)
+    {
+        if (m_stopping) return nullptr;
+        for (int i = 0; i < (int)m_slots.size(); i++)
+        {
+            if (!m_slots[i].in_use)
+            {
+                m_slots[i].in_use = true;
+                slot = i;
+                return m_mapped + m_slot_size * i;
+            }
+        }
+        m_slot_freed.wait(lock);
+    }
+}
+
+void TextureUploader::release(int slot)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_slots[slot].in_use = false;
+    }
+    m_slot_freed.notify_one();
+}
+
+bool TextureUploader::idle()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const Slot& slot : m_slots)
+    {
+        if (slot.fence != 0) return false;
+    }
+    return true;
+}
+
+void TextureUploader::submit(int id, int slot, int width, int height, int mip_levels)
+{
+    PROFILE_SCOPE("submit_texture");
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    GLState::bind_texture(texture);
+
+    // With an unpack buffer bound the pointer is an offset into it, and the copy happens on
+    // the GPU's time instead of ours
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    const void* pixels = (const void*)(m_slot_size * slot);
+    if (m_texture_storage)
+    {
+        // Immutable storage for the whole chain up front, the driver never has to reallocate it
+        glTexStorage2D(GL_TEXTURE_2D, mip_levels + 1, GL_RGBA8, width, height);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+    else
+    {
+        // the base level only, glGenerateMipmap allocates the rest up to GL_TEXTURE_MAX_LEVEL
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mip_levels);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_slots[slot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_slots[slot].id = id;
+    m_slots[slot].texture = texture;
+}
+
+std::vector<FinishedUpload> TextureUploader::poll()
+{
+    std::vector<FinishedUpload> finished;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Slot& slot : m_slots)
+        {
+            if (slot.fence == 0) continue;
+
+            // zero timeout, just asking. The flush makes sure the fence gets to the GPU at all.
+            GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+
+            glDeleteSync(slot.fence);
+            finished.push_back({ slot.id, slot.texture });
+            slot = Slot();
+        }
+    }
+    if (!finished.empty()) m_slot_freed.notify_all();
+    return finished;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "GLState.h"
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// A texture whose pixels have finished copying out of the staging ring and can be drawn with
+struct FinishedUpload
+{
+    int id;
+    GLuint texture;
+};
+
+/**
+ Streams textures through a ring of pixel unpack buffer slots that stay mapped the whole time,
+ so decoder threads can write pixels straight into memory the GPU copies from.
+
+ A decoder calls acquire() for a slot and fills it, then the GL thread calls submit(). That
+ allocates the texture (immutable storage where the driver has it) and starts the copy out of
+ the slot with a fence behind it. poll() checks the fences without waiting, hands back
+ whichever textures are done and frees their slots for the next acquire(). Nothing on the GL
+ thread ever blocks on the copy.
+
+ Needs persistent mapping (GL 4.4 or ARB_buffer_storage); initialise() returns false without
+ it and the caller should keep using glTexImage2D.
+ */
+class TextureUploader
+{
+public:
+    bool initialise(int slot_count, size_t slot_size);
+    void stop();      // any thread. Wakes up anyone stuck in acquire(), and every acquire() after gets nullptr
+    void shutdown();  // stop(), then waits for copies in flight and unmaps. Nobody may be writing a slot by now
+
+    bool available() const { return m_buffer != 0; }
+    bool idle();  // nothing submitted that poll() hasn't handed back yet
+
+    // Any thread. Blocks until a slot is free, nullptr if bytes won't fit in one or we're
+    // shutting down. slot is what to hand to submit() or release().
+    unsigned char* acquire(size_t bytes, int& slot);
+    void release(int slot);  // give a slot back without uploading from it
+
+    // GL thread only
+    void submit(int id, int slot, int width, int height, int mip_levels);
+    std::vector<FinishedUpload> poll();
+
+private:
+    struct Slot
+    {
+        bool in_use = false;
+        GLsync fence = 0;
+        int id = 0;
+        GLuint texture = 0;
+    };
+
+    GLuint m_buffer = 0;
+    unsigned char* m_mapped = nullptr;
+    size_t m_slot_size = 0;
+    bool m_texture_storage = false;  // glTexStorage2D (GL 4.2 or ARB_texture_storage), glTexImage2D if not
+
+    std::mutex m_mutex;
+    std::condition_variable m_slot_freed;
+    std::vector<Slot> m_slots;
+    bool m_stopping = false;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ Hands the latest value from one writer thread to one reader thread without either ever waiting.
+ There are three slots: the writer fills its back slot and swaps it with the middle one, the
+ reader swaps its front slot with the middle one whenever something new has landed there.
+ The reader always sees a complete value, and a slow reader just skips the ones it missed.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Writer side: fill this in, then publish() it
+    T& write_buffer() { return m_slots[m_back]; }
+
+    void publish()
+    {
+        uint8_t previous = m_middle.exchange((uint8_t)(m_back | FRESH), std::memory_order_acq_rel);
+        m_back = previous & INDEX;
+    }
+
+    // Reader side: grabs the newest published value if there is one, true if it changed
+    bool update()
+    {
+        if ((m_middle.load(std::memory_order_relaxed) & FRESH) == 0) return false;
+
+        uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & INDEX;
+        return true;
+    }
+
+    const T& read_buffer() const { return m_slots[m_front]; }
+
+private:
+    static constexpr uint8_t INDEX = 0x3;
+    static constexpr uint8_t FRESH = 0x4;  // set on the middle slot when the writer has put something new there
+
+    T m_slots[3];
+    uint8_t m_back = 0;                  // only touched by the writer
+    uint8_t m_front = 1;                 // only touched by the reader
+    std::atomic<uint8_t> m_middle{ 2 };
+};
@@ -0,0 +1,75 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(unsigned int thread_count)
+{
+    for (unsigned int i = 1; i < thread_count; i++)
+    {
+        m_threads.emplace_back(&WorkerPool::worker_loop, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (std::thread& thread : m_threads) thread.join();
+}
+
+void WorkerPool::run_chunk(unsigned int index)
+{
+    size_t chunks = size();
+    size_t begin = m_count * index / chunks;
+    size_t end = m_count * (index + 1) / chunks;
+    if (begin < end) (*m_job)(begin, end);
+}
+
+void WorkerPool::parallel_for(size_t count, const std::function<void(size_t, size_t)>& fn)
+{
+    if (m_threads.empty() || count < 2)
+    {
+        if (count > 0) fn(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &fn;
+        m_count = count;
+        m_pending = (unsigned int)m_threads.size();
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    run_chunk(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_pending == 0; });
+    m_job = nullptr;
+}
+
+void WorkerPool::worker_loop(unsigned int index)
+{
+    unsigned long long seen_generation = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stopping || m_generation != seen_generation; });
+            if (m_stopping) return;
+            seen_generation = m_generation;
+        }
+
+        run_chunk(index);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending--;
+        }
+        m_done.notify_one();
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ A fixed set of threads that sit idle until parallel_for() hands them a range.
+ The calling thread works on the first chunk itself, so a pool of size 1 has no extra threads
+ and just runs everything inline.
+ */
+class WorkerPool
+{
+public:
+    explicit WorkerPool(unsigned int thread_count);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    unsigned int size() const { return (unsigned int)m_threads.size() + 1; }
+
+    // Splits [0, count) into one contiguous chunk per thread and calls fn(begin, end) on each.
+    // Chunks are always the same for the same count and pool size, so results don't depend on timing.
+    void parallel_for(size_t count, const std::function<void(size_t, size_t)>& fn);
+
+private:
+    void worker_loop(unsigned int index);
+    void run_chunk(unsigned int index);
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    const std::function<void(size_t, size_t)>* m_job = nullptr;
+    size_t m_count = 0;
+    unsigned long long m_generation = 0;  // bumped for every parallel_for so workers know there's new work
+    unsigned int m_pending = 0;
+    bool m_stopping = false;
+};
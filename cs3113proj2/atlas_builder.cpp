@@ -0,0 +1,443 @@
+/**
+* Atlas builder: packs sprite PNGs into one texture and writes a manifest of where each one
+* went, so the game can draw every sprite from a single texture bind.
+*
+* Usage: atlas_builder [--max-sprite N] [--padding N] [--mip-levels N] OUTPUT input.png...
+*
+* Writes OUTPUT.png and OUTPUT.txt. Sprites are named after their file, without the folder
+* or extension. Anything bigger than --max-sprite on a side gets box-filtered down first.
+*
+* --mip-levels N keeps sprites from bleeding into each other down to mip level N: every
+* sprite's cell starts on a multiple of 2^N pixels and has at least 2^N pixels of padding,
+* so no texel at that level or above straddles two sprites.
+**/
+
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "stb_image.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define LOG(argument) std::cout << argument << '\n'
+
+constexpr int DEFAULT_MAX_SPRITE = 256;  // nothing in the game is drawn much bigger than this on screen
+constexpr int DEFAULT_PADDING = 1;       // edge pixels copied outwards, so filtering can't pull in a neighbour
+constexpr int DEFAULT_MIP_LEVELS = 3;    // down to 32 px per sprite, smaller than anything gets drawn
+
+struct Sprite
+{
+    std::string name;
+    int width = 0, height = 0;
+    std::vector<uint8_t> pixels;  // RGBA
+    int x = 0, y = 0;             // where it landed, not counting padding
+};
+
+// Shrinks by a whole factor, averaging colour weighted by alpha so transparent pixels don't darken the edges
+void box_downsample(Sprite& sprite, int factor)
+{
+    int width = sprite.width / factor, height = sprite.height / factor;
+    std::vector<uint8_t> result((size_t)width * height * 4);
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            double red = 0.0, green = 0.0, blue = 0.0, alpha = 0.0;
+            for (int sy = 0; sy < factor; sy++)
+            {
+                const uint8_t* row = &sprite.pixels[((size_t)(y * factor + sy) * sprite.width + x * factor) * 4];
+                for (int sx = 0; sx < factor; sx++)
+                {
+                    double a = row[sx * 4 + 3];
+                    red += row[sx * 4 + 0] * a;
+                    green += row[sx * 4 + 1] * a;
+                    blue += row[sx * 4 + 2] * a;
+                    alpha += a;
+                }
+            }
+
+            uint8_t* out = &result[((size_t)y * width + x) * 4];
+            if (alpha > 0.0)
+            {
+                out[0] = (uint8_t)std::lround(red / alpha);
+                out[1] = (uint8_t)std::lround(green / alpha);
+                out[2] = (uint8_t)std::lround(blue / alpha);
+            }
+            else out[0] = out[1] = out[2] = 0;
+            out[3] = (uint8_t)std::lround(alpha / (factor * factor));
+        }
+    }
+
+    sprite.width = width;
+    sprite.height = height;
+    sprite.pixels.swap(result);
+}
+
+/**
+ Skyline packing: the top edge of everything placed so far is kept as a list of flat
+ segments, and each new rectangle goes wherever it ends up lowest, leftmost on ties.
+ */
+struct Skyline
+{
+    struct Segment { int x, y, width; };
+    std::vector<Segment> segments;
+    int width;
+
+    explicit Skyline(int atlas_width) : segments{ { 0, 0, atlas_width } }, width(atlas_width) {}
+
+    // y if a rectangle this wide sat on top of the skyline starting at segment index, -1 if it doesn't fit
+    int fit(size_t index, int rect_width) const
+    {
+        int x = segments[index].x;
+        if (x + rect_width > width) return -1;
+
+        int y = 0;
+        for (size_t i = index; x + rect_width > segments[i].x; i++)
+        {
+            y = std::max(y, segments[i].y);
+            if (i + 1 == segments.size()) break;
+        }
+        return y;
+    }
+
+    bool insert(int rect_width, int rect_height, int& out_x, int& out_y)
+    {
+        size_t best = segments.size();
+        int best_y = 0;
+        for (size_t i = 0; i < segments.size(); i++)
+        {
+            int y = fit(i, rect_width);
+            if (y >= 0 && (best == segments.size() || y < best_y))
+            {
+                best = i;
+                best_y = y;
+            }
+        }
+        if (best == segments.size()) return false;
+
+        out_x = segments[best].x;
+        out_y = best_y;
+
+        // the new rectangle's top replaces every segment it covers, the last one may be cut short
+        Segment top = { out_x, best_y + rect_height, rect_width };
+        size_t end = best;
+        while (end < segments.size() && segments[end].x + segments[end].width <= out_x + rect_width) end++;
+        if (end < segments.size() && segments[end].x < out_x + rect_width)
+        {
+            int cut = out_x + rect_width - segments[end].x;
+            segments[end].x += cut;
+            segments[end].width -= cut;
+        }
+        segments.erase(segments.begin() + best, segments.begin() + end);
+        segments.insert(segments.begin() + best, top);
+
+        // join neighbours at the same height so later fits see one wide segment
+        for (size_t i = 0; i + 1 < segments.size(); )
+        {
+            if (segments[i].y == segments[i + 1].y)
+            {
+                segments[i].width += segments[i + 1].width;
+                segments.erase(segments.begin() + i + 1);
+            }
+            else i++;
+        }
+        return true;
+    }
+};
+
+// Fully transparent pixels are usually black, which filtering and mipmapping would average
+// into a dark fringe. Give each one the colour of its nearest visible neighbours instead,
+// growing outwards one ring at a time. Alpha stays 0.
+void bleed_colour(Sprite& sprite)
+{
+    const int width = sprite.width, height = sprite.height;
+    std::vector<uint8_t> known((size_t)width * height);
+    std::vector<int> ring, next;
+    for (int i = 0; i < width * height; i++)
+    {
+        known[i] = sprite.pixels[(size_t)i * 4 + 3] > 0;
+    }
+    for (int i = 0; i < width * height; i++)
+    {
+        if (known[i]) continue;
+        int x = i % width, y = i / width;
+        if ((x > 0 && known[i - 1]) || (x + 1 < width && known[i + 1]) || (y > 0 && known[i - width]) || (y + 1 < height && known[i + width]))
+        {
+            ring.push_back(i);
+        }
+    }
+
+    while (!ring.empty())
+    {
+        // colours for the whole ring come from what was known before it, so the order doesn't matter
+        std::vector<uint8_t> colours(ring.size() * 3);
+        for (size_t r = 0; r < ring.size(); r++)
+        {
+            int i = ring[r], x = i % width, y = i / width;
+            int total[3] = { 0, 0, 0 }, count = 0;
+            for (int dy = -1; dy <= 1; dy++)
+            {
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    int nx = x + dx, ny = y + dy;
+                    if (nx < 0 || ny < 0 || nx >= width || ny >= height || !known[ny * width + nx]) continue;
+                    for (int c = 0; c < 3; c++) total[c] += sprite.pixels[((size_t)ny * width + nx) * 4 + c];
+                    count++;
+                }
+            }
+            for (int c = 0; c < 3; c++) colours[r * 3 + c] = (uint8_t)(total[c] / count);
+        }
+
+        next.clear();
+        for (size_t r = 0; r < ring.size(); r++)
+        {
+            int i = ring[r];
+            memcpy(&sprite.pixels[(size_t)i * 4], &colours[r * 3], 3);
+            known[i] = 1;
+        }
+        for (int i : ring)
+        {
+            int x = i % width, y = i / width;
+            int neighbours[4] = { x > 0 ? i - 1 : -1, x + 1 < width ? i + 1 : -1, y > 0 ? i - width : -1, y + 1 < height ? i + width : -1 };
+            for (int n : neighbours)
+            {
+                if (n >= 0 && !known[n] && (next.empty() || next.back() != n)) next.push_back(n);
+            }
+        }
+        std::sort(next.begin(), next.end());
+        next.erase(std::unique(next.begin(), next.end()), next.end());
+        ring.swap(next);
+    }
+}
+
+// How much room a sprite side takes up once padded and rounded up to the alignment
+int cell_size(int size, int padding, int alignment)
+{
+    return (size + 2 * padding + alignment - 1) / alignment * alignment;
+}
+
+// Packs at the given width, returns the height used or -1 if a sprite is wider than that
+int pack(std::vector<Sprite>& sprites, int width, int padding, int alignment)
+{
+    Skyline skyline(width);
+    int height = 0;
+    for (Sprite& sprite : sprites)
+    {
+        int x, y;
+        int cell_width = cell_size(sprite.width, padding, alignment), cell_height = cell_size(sprite.height, padding, alignment);
+        if (!skyline.insert(cell_width, cell_height, x, y)) return -1;
+        sprite.x = x + padding;
+        sprite.y = y + padding;
+        height = std::max(height, y + cell_height);
+    }
+    return height;
+}
+
+// PNG with stored (uncompressed) deflate blocks: no zlib needed, and stb_image reads it fine
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1u)));
+    }
+    return ~crc;
+}
+
+void put_u32(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back((uint8_t)(value >> 24));
+    out.push_back((uint8_t)(value >> 16));
+    out.push_back((uint8_t)(value >> 8));
+    out.push_back((uint8_t)value);
+}
+
+void put_chunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+{
+    put_u32(out, (uint32_t)data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    put_u32(out, crc32(&out[start], out.size() - start));
+}
+
+bool write_png(const char* path, const std::vector<uint8_t>& pixels, int width, int height)
+{
+    // every row gets filter type 0 in front
+    std::vector<uint8_t> raw;
+    raw.reserve((size_t)(width * 4 + 1) * height);
+    for (int y = 0; y < height; y++)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), pixels.begin() + (size_t)y * width * 4, pixels.begin() + (size_t)(y + 1) * width * 4);
+    }
+
+    std::vector<uint8_t> zlib = { 0x78, 0x01 };
+    for (size_t offset = 0; offset < raw.size() || offset == 0; offset += 65535)
+    {
+        size_t size = std::min(raw.size() - offset, (size_t)65535);
+        zlib.push_back(offset + size == raw.size() ? 1 : 0);
+        zlib.push_back((uint8_t)size);
+        zlib.push_back((uint8_t)(size >> 8));
+        zlib.push_back((uint8_t)~size);
+        zlib.push_back((uint8_t)(~size >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+    }
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : raw)
+    {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_u32(zlib, (b << 16) | a);
+
+    std::vector<uint8_t> header;
+    put_u32(header, (uint32_t)width);
+    put_u32(header, (uint32_t)height);
+    header.insert(header.end(), { 8, 6, 0, 0, 0 });  // 8 bit RGBA
+
+    std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    put_chunk(png, "IHDR", header);
+    put_chunk(png, "IDAT", zlib);
+    put_chunk(png, "IEND", {});
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) return false;
+    bool ok = fwrite(png.data(), 1, png.size(), file) == png.size();
+    fclose(file);
+    return ok;
+}
+
+std::string sprite_name(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+int main(int argc, char* argv[])
+{
+    int max_sprite = DEFAULT_MAX_SPRITE;
+    int padding = DEFAULT_PADDING;
+    int mip_levels = DEFAULT_MIP_LEVELS;
+    std::vector<const char*> paths;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--max-sprite") == 0 && i + 1 < argc) max_sprite = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--padding") == 0 && i + 1 < argc) padding = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--mip-levels") == 0 && i + 1 < argc) mip_levels = atoi(argv[++i]);
+        else paths.push_back(argv[i]);
+    }
+    if (paths.size() < 2 || max_sprite < 1 || padding < 0 || mip_levels < 0 || mip_levels > 12)
+    {
+        LOG("Usage: atlas_builder [--max-sprite N] [--padding N] [--mip-levels N] OUTPUT input.png...");
+        return 1;
+    }
+
+    // every cell on a 2^levels grid, with a whole texel of padding even at the smallest level
+    const int alignment = 1 << mip_levels;
+    padding = std::max(padding, alignment);
+
+    std::string output = paths[0];
+    std::vector<Sprite> sprites;
+    long long area = 0;
+    for (size_t i = 1; i < paths.size(); i++)
+    {
+        Sprite sprite;
+        int components;
+        unsigned char* image = stbi_load(paths[i], &sprite.width, &sprite.height, &components, STBI_rgb_alpha);
+        if (image == NULL)
+        {
+            LOG("Unable to load " << paths[i] << ": " << stbi_failure_reason());
+            return 1;
+        }
+        sprite.name = sprite_name(paths[i]);
+        sprite.pixels.assign(image, image + (size_t)sprite.width * sprite.height * 4);
+        stbi_image_free(image);
+
+        int factor = (std::max(sprite.width, sprite.height) + max_sprite - 1) / max_sprite;
+        if (factor > 1) box_downsample(sprite, factor);
+        bleed_colour(sprite);
+
+        area += (long long)cell_size(sprite.width, padding, alignment) * cell_size(sprite.height, padding, alignment);
+        sprites.push_back(std::move(sprite));
+    }
+
+    // tallest first packs tightest on a skyline, names break ties so the output is stable
+    std::sort(sprites.begin(), sprites.end(), [](const Sprite& a, const Sprite& b)
+    {
+        return a.height != b.height ? a.height > b.height : a.name < b.name;
+    });
+
+    // try a range of widths and keep whichever wastes the least
+    int widest = 0;
+    for (const Sprite& sprite : sprites) widest = std::max(widest, cell_size(sprite.width, padding, alignment));
+    int start = std::max(widest, cell_size((int)std::sqrt((double)area), 0, alignment));
+    int best_width = 0, best_height = 0;
+    for (int width = start; width <= 2 * start; width += alignment)
+    {
+        int height = pack(sprites, width, padding, alignment);
+        if (height < 0) continue;
+        if (best_width == 0 || (long long)width * height < (long long)best_width * best_height ||
+            ((long long)width * height == (long long)best_width * best_height && std::max(width, height) < std::max(best_width, best_height)))
+        {
+            best_width = width;
+            best_height = height;
+        }
+    }
+    pack(sprites, best_width, padding, alignment);
+
+    // copy each sprite in, then smear its outermost pixels across the rest of its cell
+    std::vector<uint8_t> atlas((size_t)best_width * best_height * 4, 0);
+    for (const Sprite& sprite : sprites)
+    {
+        int cell_width = cell_size(sprite.width, padding, alignment), cell_height = cell_size(sprite.height, padding, alignment);
+        for (int y = -padding; y < cell_height - padding; y++)
+        {
+            int source_y = std::min(std::max(y, 0), sprite.height - 1);
+            for (int x = -padding; x < cell_width - padding; x++)
+            {
+                int source_x = std::min(std::max(x, 0), sprite.width - 1);
+                memcpy(&atlas[((size_t)(sprite.y + y) * best_width + sprite.x + x) * 4],
+                       &sprite.pixels[((size_t)source_y * sprite.width + source_x) * 4], 4);
+            }
+        }
+    }
+
+    std::string image_path = output + ".png";
+    std::string manifest_path = output + ".txt";
+    if (!write_png(image_path.c_str(), atlas, best_width, best_height))
+    {
+        LOG("Unable to write " << image_path);
+        return 1;
+    }
+
+    FILE* manifest = fopen(manifest_path.c_str(), "w");
+    if (manifest == NULL)
+    {
+        LOG("Unable to write " << manifest_path);
+        return 1;
+    }
+    fprintf(manifest, "# written by atlas_builder, rebuild rather than edit\n");
+    fprintf(manifest, "atlas %s %d %d\n", sprite_name(image_path).append(".png").c_str(), best_width, best_height);
+    fprintf(manifest, "mip_levels %d\n", mip_levels);
+    for (const Sprite& sprite : sprites)
+    {
+        fprintf(manifest, "sprite %s %d %d %d %d\n", sprite.name.c_str(), sprite.x, sprite.y, sprite.width, sprite.height);
+    }
+    fclose(manifest);
+
+    LOG("packed " << sprites.size() << " sprites into " << best_width << "x" << best_height << " ("
+        << (int)(100.0 * area / ((double)best_width * best_height)) << "% used)");
+    return 0;
+}
@@ -0,0 +1,249 @@
+/**
+* Headless runner: plays AI-vs-AI matches through the same step() the game uses,
+* with no window or GL context, as fast as the CPU allows.
+*
+* Usage: headless [--matches N] [--balls N] [--ball-scale S] [--threads N] [--seed S] [--record FILE]
+*        headless --scaling TICKS [--balls N] [--ball-scale S] [--threads MAX]
+*        headless --replay FILE [--threads N]
+*
+* --scaling runs the same many-ball field for TICKS ticks at 1, 2, 4... threads up to MAX
+* and prints the time per tick for each, instead of playing matches.
+*
+* --record saves the first match as a replay. --replay plays one back as fast as possible,
+* checks it ends in exactly the recorded state, and reports the tick rate.
+**/
+
+#include "Replay.h"
+#include "Simulation.h"
+#include "WorkerPool.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#define LOG(argument) std::cout << argument << '\n'
+
+constexpr float MAX_MATCH_TIME = 300.0f;  // seconds of game time before we call it a draw
+constexpr float AI_DEAD_ZONE = 0.1f;      // stops the paddles jittering around the target
+constexpr float AI_AIM_ERROR = 1.4f;      // how far off an AI can misjudge the ball, so matches actually end
+
+struct AIPlayer
+{
+    float aim_offset = 0.0f;
+};
+
+// -1, 0 or 1: which way this paddle should move to meet the ball
+float ai_direction(const AIPlayer& ai, float paddle_y, float ball_y)
+{
+    float target = ball_y + ai.aim_offset;
+    if (target > paddle_y + AI_DEAD_ZONE) return 1.0f;
+    if (target < paddle_y - AI_DEAD_ZONE) return -1.0f;
+    return 0.0f;
+}
+
+// y of the closest ball heading for this paddle, heading is +1 for the right side and -1 for the left
+float incoming_ball_y(const EntityStore& balls, float paddle_x, float paddle_y, float heading)
+{
+    float best_y = paddle_y;
+    float best_distance = 1e30f;
+    for (size_t i = 0; i < balls.size(); i++)
+    {
+        if (balls.movement_x[i] * heading <= 0.0f) continue;
+
+        float distance = fabsf(paddle_x - balls.position_x[i]);
+        if (distance < best_distance)
+        {
+            best_distance = distance;
+            best_y = balls.position_y[i];
+        }
+    }
+    return best_y;
+}
+
+// Time a fixed number of ticks on the same starting field at every thread count up to max_threads
+void run_scaling_benchmark(size_t balls, float ball_scale, unsigned long long ticks, unsigned int max_threads)
+{
+    constexpr double TICK_BUDGET_MS = 1000.0 / 240.0;
+    LOG(balls << " balls, scale " << ball_scale << ", " << ticks << " ticks (budget at 240 Hz: " << TICK_BUDGET_MS << " ms/tick)");
+    LOG("threads  ms/tick  ticks/second  speedup");
+
+    double single_thread_ms = 0.0;
+    for (unsigned int threads = 1; threads <= max_threads; threads *= 2)
+    {
+        WorkerPool pool(threads);
+        GameState state;
+        state.log_collisions = false;
+        state.workers = &pool;
+        reset_game(state, balls, ball_scale);
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long long tick = 0; tick < ticks && state.status == RUNNING; tick++)
+        {
+            step(state, FIXED_TIMESTEP);
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        double ms_per_tick = elapsed.count() / (double)(state.tick > 0 ? state.tick : 1);
+        if (threads == 1) single_thread_ms = ms_per_tick;
+        LOG(threads << "        " << ms_per_tick << "  " << 1000.0 / ms_per_tick << "  " << single_thread_ms / ms_per_tick << "x");
+    }
+}
+
+// Plays a recorded match back through apply_input() and step() with no pacing at all
+int run_replay(const char* path, WorkerPool& pool)
+{
+    Replay replay;
+    if (!replay.load(path)) return 1;
+
+    GameState state;
+    state.log_collisions = false;
+    state.workers = &pool;
+    replay.restart(state);
+
+    auto start = std::chrono::steady_clock::now();
+    while (state.tick < replay.tick_count && state.status == RUNNING)
+    {
+        apply_input(state, replay.input_at(state.tick));
+        step(state, FIXED_TIMESTEP);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double seconds = elapsed.count() > 0.0 ? elapsed.count() : 1e-9;
+
+    bool matches = state.tick == replay.tick_count && Replay::state_hash(state) == replay.final_hash;
+    LOG("replay:         " << path << " (" << replay.inputs.size() << " bytes of input)");
+    LOG("ticks:          " << state.tick << " of " << replay.tick_count);
+    LOG("score:          blue " << state.blue_score << ", pink " << state.pink_score);
+    LOG("ticks/second:   " << state.tick / seconds);
+    LOG("final state:    " << (matches ? "matches recording" : "DIVERGED from recording"));
+    return matches ? 0 : 2;
+}
+
+int main(int argc, char* argv[])
+{
+    long long matches = 1000;
+    size_t balls = 1;
+    float ball_scale = BALL_SCALE;
+    unsigned int threads = 1;
+    unsigned long long scaling_ticks = 0;
+    unsigned int seed = 1;
+    const char* record_path = nullptr;
+    const char* replay_path = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--matches") == 0 && i + 1 < argc) matches = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--balls") == 0 && i + 1 < argc) balls = (size_t)atoll(argv[++i]);
+        else if (strcmp(argv[i], "--ball-scale") == 0 && i + 1 < argc) ball_scale = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = (unsigned int)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--scaling") == 0 && i + 1 < argc) scaling_ticks = (unsigned long long)atoll(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = (unsigned int)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) record_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replay_path = argv[++i];
+        else
+        {
+            LOG("Usage: headless [--matches N] [--balls N] [--ball-scale S] [--threads N] [--seed S] [--record FILE]");
+            LOG("       headless --scaling TICKS [--balls N] [--ball-scale S] [--threads MAX]");
+            LOG("       headless --replay FILE [--threads N]");
+            return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+
+    if (scaling_ticks > 0)
+    {
+        unsigned int max_threads = threads > 1 ? threads : std::thread::hardware_concurrency();
+        run_scaling_benchmark(balls, ball_scale, scaling_ticks, max_threads > 0 ? max_threads : 1);
+        return 0;
+    }
+
+    WorkerPool pool(threads);
+    if (replay_path != nullptr) return run_replay(replay_path, pool);
+
+    Replay replay;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> aim(-AI_AIM_ERROR, AI_AIM_ERROR);
+    std::uniform_real_distribution<float> serve_y(-2.0f, 2.0f);
+
+    const unsigned long long max_ticks = (unsigned long long)(MAX_MATCH_TIME / FIXED_TIMESTEP);
+    unsigned long long total_ticks = 0;
+    long long blue_wins = 0, pink_wins = 0, draws = 0;
+
+    GameState state;
+    state.log_collisions = false;
+    state.workers = &pool;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (long long match = 0; match < matches; match++)
+    {
+        reset_game(state, balls, ball_scale);
+
+        // vary the serve so every match isn't the same rally
+        if (state.balls.size() > 0)
+        {
+            state.balls.position_y[0] = state.balls.previous_y[0] = serve_y(rng);
+            state.balls.movement_x[0] = (rng() & 1) ? 1.0f : -1.0f;
+            state.balls.movement_y[0] = (rng() & 1) ? 1.0f : -1.0f;
+        }
+
+        bool recording = record_path != nullptr && match == 0;
+        if (recording) replay.begin(state);
+
+        AIPlayer blue, pink;
+        blue.aim_offset = aim(rng);
+        pink.aim_offset = aim(rng);
+
+        // the store gets sorted into grid order every so often, so the first ball is followed
+        // by its id rather than sitting at index 0
+        uint32_t first_ball = state.balls.size() > 0 ? state.balls.id[0] : 0;
+
+        InputState input;
+        while (state.status == RUNNING && state.tick < max_ticks)
+        {
+            const EntityStore& paddles = state.paddles;
+            size_t tracked = state.balls.find(first_ball);
+            float direction_before = tracked < state.balls.size() ? state.balls.movement_x[tracked] : 0.0f;
+
+            input.blue_direction = ai_direction(blue, paddles.position_y[BLUE],
+                incoming_ball_y(state.balls, paddles.position_x[BLUE], paddles.position_y[BLUE], 1.0f));
+            input.pink_direction = ai_direction(pink, paddles.position_y[PINK],
+                incoming_ball_y(state.balls, paddles.position_x[PINK], paddles.position_y[PINK], -1.0f));
+            apply_input(state, input);
+            if (recording) replay.record(input);
+            step(state, FIXED_TIMESTEP);
+
+            // whoever just returned the first ball picks a new spot to aim for next time
+            tracked = state.balls.find(first_ball);
+            if (tracked < state.balls.size() && state.balls.movement_x[tracked] != direction_before)
+            {
+                if (state.balls.movement_x[tracked] < 0.0f) blue.aim_offset = aim(rng);
+                else pink.aim_offset = aim(rng);
+            }
+        }
+
+        if (recording)
+        {
+            replay.finish(state);
+            if (replay.save(record_path)) LOG("recorded " << replay.tick_count << " ticks to " << record_path);
+        }
+
+        total_ticks += state.tick;
+        if (state.winner == BLUE_WINS) blue_wins++;
+        else if (state.winner == PINK_WINS) pink_wins++;
+        else draws++;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double seconds = elapsed.count() > 0.0 ? elapsed.count() : 1e-9;
+
+    LOG("matches:        " << matches << " (blue " << blue_wins << ", pink " << pink_wins << ", draws " << draws << ")");
+    LOG("ticks:          " << total_ticks);
+    LOG("elapsed:        " << seconds << " s");
+    LOG("matches/second: " << matches / seconds);
+    LOG("ticks/second:   " << total_ticks / seconds);
+
+    return 0;
+}
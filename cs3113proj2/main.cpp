@@ -20,13 +20,26 @@
 #include <SDL_opengl.h>
 #include "glm/mat4x4.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+#include "Profiler.h"
+#include "CameraBuffer.h"
 #include "ShaderProgram.h"
+#include "SpriteBatch.h"
+#include "AssetLoader.h"
+#include "TextureUploader.h"
+#include "BakedTexture.h"
+#include "BlockCompression.h"
+#include "TextureAtlas.h"
+#include "SimulationThread.h"
 #include "stb_image.h"
 #include "cmath"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
 #include <ctime>
+#include <memory>
 
 #define LOG(argument) std::cout << argument << '\n'
-enum AppStatus { RUNNING, TERMINATED };
 
 constexpr int WINDOW_WIDTH = 640,
 WINDOW_HEIGHT = 480;
@@ -41,151 +54,371 @@ VIEWPORT_Y = 0,
 VIEWPORT_WIDTH = WINDOW_WIDTH,
 VIEWPORT_HEIGHT = WINDOW_HEIGHT;
 
-constexpr char V_SHADER_PATH[] = "shaders/vertex_textured.glsl",
-F_SHADER_PATH[] = "shaders/fragment_textured.glsl";
+// #version 330 shaders, uniform blocks, VAOs, instancing and fences all need at least this
+constexpr int REQUIRED_GL_MAJOR = 3,
+REQUIRED_GL_MINOR = 3;
 
-constexpr float MILLISECONDS_IN_SECOND = 1000.0;
-
-constexpr char BLUE_SPRITE_FILEPATH[] = "assets/guyBlue.png",
-PINK_SPRITE_FILEPATH[] = "assets/guyPink.png",
-BALL_SPRITE_FILEPATH[] = "assets/ball.png",
-HIT_SPRITE_FILEPATH[] = "assets/ballAlt.png";
-
-constexpr float MINIMUM_COLLISION_DISTANCE = 1.0f;
-constexpr glm::vec3 INIT_SCALE = glm::vec3(2.5f, 2.5f, 0.0f),
-INIT_SCALE_BALL = glm::vec3(1.0f, 1.0f, 0.0f);
-
-
-SDL_Window* g_display_window;
-
-AppStatus g_app_status = RUNNING;
-ShaderProgram g_shader_program;
-glm::mat4 g_view_matrix, g_blue_matrix, g_pink_matrix, g_projection_matrix, g_trans_matrix, g_ball_matrix;
+constexpr char V_SHADER_PATH[] = "shaders/vertex_textured_instanced.glsl",
+F_SHADER_PATH[] = "shaders/fragment_textured_instanced.glsl";
 
-float g_previous_ticks = 0.0f;
+constexpr float MILLISECONDS_IN_SECOND = 1000.0;
 
-GLuint g_blue_texture_id;
-GLuint g_pink_texture_id;
-GLuint g_ball_texture_id;
-GLuint g_hit_texture_id;
+// Every sprite lives in one atlas, rebuilt from the separate PNGs with
+// atlas_builder assets/atlas assets/guyBlue.png assets/guyPink.png assets/ball.png assets/ballAlt.png
+// then baked for loading with texture_baker --mip-levels 3 --bc3 assets/atlas.png
+constexpr char ATLAS_MANIFEST_FILEPATH[] = "assets/atlas.txt";
 
-glm::vec3 g_blue_position = glm::vec3(3.5f, 0.0f, 0.0f);
-glm::vec3 g_blue_movement = glm::vec3(0.0f, 1.0f, 0.0f);
+// Staging memory for texture uploads, each slot holds one 1024x1024 RGBA8 image
+constexpr int TEXTURE_STAGING_SLOTS = 4;
+constexpr size_t TEXTURE_STAGING_SLOT_SIZE = 1024 * 1024 * 4;
 
-glm::vec3 g_pink_position = glm::vec3(-3.5f, 0.0f, 0.0f);
-glm::vec3 g_pink_movement = glm::vec3(0.0f, 0.0f, 0.0f);
+// Decoder threads, there's only the atlas at startup and the odd skin after that, so a couple
+// is plenty without competing with the simulation for cores
+constexpr unsigned int ASSET_LOADER_THREADS = 2;
 
-glm::vec3 g_ball_position = glm::vec3(-2.0f, -2.0f, 0.0f);
-glm::vec3 g_ball_movement = glm::vec3(1.0f, 1.0f, 0.0f);
-glm::vec3 g_ball_rotation = glm::vec3(0.0f, 0.0f, 0.0f);
-glm::vec3 g_ball_spin = glm::vec3(0.0f, 0.0f, -1.0f); // bad naming, but this will be spin direction
+// ids for the images handed to g_assets
+enum AssetId { ATLAS_ASSET };
 
+// atlas names for each SpriteId
+constexpr const char* SPRITE_NAMES[SPRITE_COUNT] = { "guyBlue", "guyPink", "ball", "ballAlt" };
 
-float g_blue_speed = 2.4f;  // move 1.6 unit per second
-float g_ball_speed = 1.0f;  // move 1 unit per second
 
-bool hit = false;
-int hitFrames = 0;
-constexpr int HIT_RECOVERY = 360;
+SDL_Window* g_display_window;
 
-bool playerTwo = true;
+SimulationThread g_simulation;
+const RenderSnapshot* g_snapshot = nullptr;  // newest finished tick, owned by g_simulation
+InputState g_input;  // latest input, one-shot flags stay set until the sim thread has them
+ShaderProgram g_shader_program;
+CameraBuffer g_camera;
+glm::mat4 g_view_matrix, g_projection_matrix;
+
+float g_alpha = 0.0f;  // how far we are between the last two physics states, for interpolation
+
+TextureAtlas g_atlas;
+GLuint g_atlas_texture_id;  // the placeholder until g_assets has finished the atlas
+GLuint g_placeholder_texture_id;
+bool g_atlas_premultiplied = false;  // only baked atlases can be
+TextureUploader g_uploader;  // staging ring the decoders write into, when the driver can map it persistently
+std::unique_ptr<AssetLoader> g_assets;  // created in initialise(), joined in shutdown()
+double g_startup_time = 0.0;  // SimulationThread::now() when main started, for load timings
+AtlasRegion g_sprite_regions[SPRITE_COUNT];  // indexed by SpriteId
+GLuint g_quad_vbo;                          // the unit quad every sprite is drawn with, uploaded once
+SpriteBatch g_sprite_batch;
+size_t g_ball_count = 1;
+float g_ball_scale = BALL_SCALE;
+Replay g_replay;  // only used with --replay
+int g_max_texture_size = 0;  // 0 means textures keep their full size
 
 #define LOG(argument) std::cout << argument << '\n'
-void initialise();
+bool initialise();
 void process_input();
 void update();
 void render();
 void shutdown();
 
-float clamp(float value, float min, float max);
-bool checkBoxCircleCollision(const glm::vec3& boxCenter, float boxHalfWidth, float boxHalfHeight, const glm::vec3& circleCenter, float circleRadius);
+// Unit quad as a triangle strip, position then texture coordinate for each vertex
+constexpr float QUAD_VERTICES[] = {
+    -0.5f, -0.5f, 0.0f, 1.0f,   0.5f, -0.5f, 1.0f, 1.0f,
+    -0.5f,  0.5f, 0.0f, 0.0f,   0.5f,  0.5f, 1.0f, 0.0f,
+};
 
 constexpr int NUMBER_OF_TEXTURES = 1; // to be generated, that is
 constexpr GLint LEVEL_OF_DETAIL = 0;  // base image level; Level n is the nth mipmap reduction image
 constexpr GLint TEXTURE_BORDER = 0;   // this value MUST be zero
 
-GLuint load_texture(const char* filepath)
+// Uploads an image the asset loader finished decoding, mip_levels is how many reductions below
+// the base are worth keeping, see atlas_builder
+GLuint upload_texture(DecodedImage& image)
 {
-    // STEP 1: Loading the image file
-    int width, height, number_of_components;
-    unsigned char* image = stbi_load(filepath, &width, &height, &number_of_components, STBI_rgb_alpha);
-
-    if (image == NULL)
+    // STEP 1: Checking the image made it off the disk, keep drawing the placeholder if not
+    if (image.pixels == NULL)
     {
-        LOG("Unable to load image. Make sure the path is correct.");
-        assert(false);
+        LOG("Unable to load image " << image.path << ". Make sure the path is correct.");
+        return g_placeholder_texture_id;
     }
 
     // STEP 2: Generating and binding a texture ID to our image
     GLuint textureID;
     glGenTextures(NUMBER_OF_TEXTURES, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, LEVEL_OF_DETAIL, GL_RGBA, width, height, TEXTURE_BORDER, GL_RGBA, GL_UNSIGNED_BYTE, image);
+    GLState::bind_texture(textureID);
+    glTexImage2D(GL_TEXTURE_2D, LEVEL_OF_DETAIL, GL_RGBA, image.width, image.height, TEXTURE_BORDER, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
+
+    // STEP 3: Building the mip chain and setting our texture filter parameters, trilinear so
+    // shrunken sprites don't shimmer
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.mip_levels);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // STEP 4: Releasing our image from memory and returning our texture id
+    AssetLoader::free_image(image);
+
+    return textureID;
+}
+
+// A single flat grey texel that stands in for textures still being decoded
+GLuint create_placeholder_texture()
+{
+    const unsigned char grey[4] = { 160, 160, 160, 255 };
 
-    // STEP 3: Setting our texture filter parameters
+    GLuint textureID;
+    glGenTextures(NUMBER_OF_TEXTURES, &textureID);
+    GLState::bind_texture(textureID);
+    glTexImage2D(GL_TEXTURE_2D, LEVEL_OF_DETAIL, GL_RGBA, 1, 1, TEXTURE_BORDER, GL_RGBA, GL_UNSIGNED_BYTE, grey);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    return textureID;
+}
+
+// image.png's baked counterpart from texture_baker, image.tex
+std::string baked_path(const std::string& image_path)
+{
+    size_t dot = image_path.find_last_of('.');
+    return (dot == std::string::npos ? image_path : image_path.substr(0, dot)) + ".tex";
+}
+
+bool has_extension(const char* name)
+{
+    GLint extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+    for (GLint i = 0; i < extensions; i++)
+    {
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0) return true;
+    }
+    return false;
+}
+
+// Uploads every level straight out of the mapped file, no decoding and no copy of our own.
+// 0 if there's no baked texture or it was baked from an older source_path, in which case it's
+// the PNG as usual until it's rebaked.
+// BC3 levels stay compressed on the GPU when the driver has S3TC, and get unpacked here when not.
+GLuint load_baked_texture(const std::string& path, const std::string& source_path, int mip_levels, bool& premultiplied)
+{
+    PROFILE_SCOPE("load_baked_texture");
+    double start = SimulationThread::now();
+
+    BakedTexture baked;
+    if (!baked.open(path)) return 0;
+    if (!baked.matches_source(source_path))
+    {
+        LOG(path << " was baked from a different " << source_path << ", rebake it. Loading the PNG for now.");
+        return 0;
+    }
+    bool upload_compressed = baked.compressed() && has_extension("GL_EXT_texture_compression_s3tc");
+    size_t gpu_bytes = 0, rgba_bytes = 0;
+    std::vector<uint8_t> unpacked;
+
+    // Nothing gets drawn bigger than g_max_texture_size, so levels above that are never even read
+    uint32_t first = 0;
+    while (g_max_texture_size > 0 && first + 1 < baked.level_count() && mip_levels > 0 &&
+           ((int)baked.level(first).width > g_max_texture_size || (int)baked.level(first).height > g_max_texture_size))
+    {
+        first++;
+        mip_levels--;
+    }
+    uint32_t last = std::min(first + mip_levels, baked.level_count() - 1);
+
+    GLuint textureID;
+    glGenTextures(NUMBER_OF_TEXTURES, &textureID);
+    GLState::bind_texture(textureID);
+    for (uint32_t level = first; level <= last; level++)
+    {
+        const BakedLevel& info = baked.level(level);
+        rgba_bytes += (size_t)info.width * info.height * 4;
+
+        if (upload_compressed)
+        {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level - first, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, info.width, info.height,
+                                   TEXTURE_BORDER, (GLsizei)info.size, baked.level_pixels(level));
+            gpu_bytes += (size_t)info.size;
+            continue;
+        }
+
+        const void* pixels = baked.level_pixels(level);
+        if (baked.compressed())
+        {
+            unpacked.resize((size_t)info.width * info.height * 4);
+            decompress_bc3((const uint8_t*)pixels, info.width, info.height, unpacked.data());
+            pixels = unpacked.data();
+        }
+        glTexImage2D(GL_TEXTURE_2D, level - first, GL_RGBA, info.width, info.height,
+                     TEXTURE_BORDER, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        gpu_bytes += (size_t)info.width * info.height * 4;
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, last - first);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    // STEP 4: Releasing our file from memory and returning our texture id
-    stbi_image_free(image);
+    // tint alpha only scales the texture's alpha in the shader, fine as long as tints stay opaque
+    premultiplied = baked.premultiplied();
 
+    LOG(path << ": " << (upload_compressed ? "BC3" : baked.compressed() ? "BC3 unpacked to RGBA8, no S3TC" : "RGBA8") << ", "
+        << gpu_bytes / 1024 << " KiB on the GPU (" << (rgba_bytes - gpu_bytes) / 1024 << " KiB saved), loaded in "
+        << (SimulationThread::now() - start) * 1000.0 << " ms");
     return textureID;
 }
 
-void initialise()
+// A texture is fully uploaded and safe to draw with
+void texture_ready(int id, GLuint texture)
+{
+    // didn't load, keep drawing whatever was there before
+    if (texture == g_placeholder_texture_id) return;
+
+    switch (id)
+    {
+    case ATLAS_ASSET:
+        // may be a new skin replacing the old atlas mid-match. GL unbinds it and may hand the
+        // name straight back out to the next glGenTextures, so GLState can't go on thinking it's bound
+        if (g_atlas_texture_id != g_placeholder_texture_id)
+        {
+            glDeleteTextures(1, &g_atlas_texture_id);
+            GLState::invalidate();
+        }
+        g_atlas_texture_id = texture;
+        LOG("Atlas ready " << (SimulationThread::now() - g_startup_time) * 1000.0 << " ms after startup");
+        break;
+
+    default:
+        glDeleteTextures(1, &texture);
+        GLState::invalidate();
+        break;
+    }
+}
+
+// Starts uploads for whatever finished decoding since last frame, and swaps in the ones whose
+// copies are done. Never waits on the GPU.
+void upload_finished_textures()
+{
+    if (g_assets->idle() && g_uploader.idle()) return;
+
+    PROFILE_SCOPE("upload_textures");
+    for (DecodedImage& image : g_assets->take_finished())
+    {
+        if (image.staging_slot >= 0)
+        {
+            // comes back out of poll() once the GPU has it
+            g_uploader.submit(image.id, image.staging_slot, image.width, image.height, image.mip_levels);
+            AssetLoader::free_image(image);
+        }
+        else
+        {
+            texture_ready(image.id, upload_texture(image));
+        }
+    }
+
+    for (const FinishedUpload& upload : g_uploader.poll()) texture_ready(upload.id, upload.texture);
+}
+
+// Puts the quad in a VBO once, the sprite batch draws every sprite as an instance of it
+void create_quad()
+{
+    glGenBuffers(1, &g_quad_vbo);
+    GLState::bind_array_buffer(g_quad_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(QUAD_VERTICES), QUAD_VERTICES, GL_STATIC_DRAW);
+}
+
+// Undoes as much of the window and context setup as initialise() got through, newest first
+void abandon_window(SDL_GLContext context)
+{
+    if (context != nullptr) SDL_GL_DeleteContext(context);
+    if (g_display_window != nullptr) SDL_DestroyWindow(g_display_window);
+    g_display_window = nullptr;
+    SDL_Quit();
+}
+
+bool initialise()
 {
     SDL_Init(SDL_INIT_VIDEO);
+
+    // Ask for 3.3 outright, otherwise macOS hands out a 2.1 legacy context. Core profile there
+    // has to be forward-compatible too.
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, REQUIRED_GL_MAJOR);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, REQUIRED_GL_MINOR);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+#ifdef __APPLE__
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG);
+#endif
+
     g_display_window = SDL_CreateWindow("Pawng",
         SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
         WINDOW_WIDTH, WINDOW_HEIGHT,
         SDL_WINDOW_OPENGL);
-
-    SDL_GLContext context = SDL_GL_CreateContext(g_display_window);
-    SDL_GL_MakeCurrent(g_display_window, context);
-
-
-    if (g_display_window == nullptr)
+    SDL_GLContext context = g_display_window != nullptr ? SDL_GL_CreateContext(g_display_window) : nullptr;
+    if (context == nullptr)
     {
-        shutdown();
+        LOG("Unable to create an OpenGL " << REQUIRED_GL_MAJOR << "." << REQUIRED_GL_MINOR << " context: " << SDL_GetError());
+        abandon_window(context);
+        return false;
     }
+    SDL_GL_MakeCurrent(g_display_window, context);
+
 #ifdef _WINDOWS
+    glewExperimental = GL_TRUE;  // otherwise GLEW skips most of the GL 3 entry points in a core profile
     glewInit();
 #endif
 
+    // drivers are allowed to hand back something older than asked for
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int major = 0, minor = 0;
+    if (version == nullptr || sscanf(version, "%d.%d", &major, &minor) != 2 ||
+        major < REQUIRED_GL_MAJOR || (major == REQUIRED_GL_MAJOR && minor < REQUIRED_GL_MINOR))
+    {
+        LOG("OpenGL " << REQUIRED_GL_MAJOR << "." << REQUIRED_GL_MINOR << " is needed, the driver gave us "
+            << (version != nullptr ? version : "nothing"));
+        abandon_window(context);
+        return false;
+    }
+
     glViewport(VIEWPORT_X, VIEWPORT_Y, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
 
     g_shader_program.load(V_SHADER_PATH, F_SHADER_PATH);
-
-    g_blue_matrix = glm::mat4(1.0f);
-    g_ball_matrix = glm::mat4(1.0f);
-    g_ball_matrix = glm::translate(g_ball_matrix, glm::vec3(1.0f, 1.0f, 0.0f));
-    g_ball_position += g_ball_movement;
+    g_camera.initialise();
+    g_shader_program.bind_uniform_block("Camera", CAMERA_BINDING);
+    create_quad();
+    g_sprite_batch.initialise(g_shader_program, g_quad_vbo);
 
     g_view_matrix = glm::mat4(1.0f);  // Defines the position (location and orientation) of the camera
     g_projection_matrix = glm::ortho(-5.0f, 5.0f, -3.75f, 3.75f, -1.0f, 1.0f);  // Defines the characteristics of your camera, such as clip planes, field of view, projection method etc.
 
-    g_shader_program.set_projection_matrix(g_projection_matrix);
-    g_shader_program.set_view_matrix(g_view_matrix);
+    g_camera.update(g_view_matrix, g_projection_matrix);
 
-    glUseProgram(g_shader_program.get_program_id());
+    GLState::use_program(g_shader_program.get_program_id());
 
     glClearColor(BG_RED, BG_BALL, BG_GREEN, BG_OPACITY);
 
-    g_blue_texture_id = load_texture(BLUE_SPRITE_FILEPATH);
-    g_pink_texture_id = load_texture(PINK_SPRITE_FILEPATH);
-    g_ball_texture_id = load_texture(BALL_SPRITE_FILEPATH);
-    g_hit_texture_id = load_texture(HIT_SPRITE_FILEPATH);
+    // A baked atlas goes straight from the mapped file to GL. Without one the PNG decodes in the
+    // background, and sprites draw with the placeholder until it's uploaded.
+    if (!g_atlas.load(ATLAS_MANIFEST_FILEPATH)) assert(false);
+    g_placeholder_texture_id = create_placeholder_texture();
+    g_atlas_texture_id = g_placeholder_texture_id;
+    g_assets.reset(new AssetLoader(ASSET_LOADER_THREADS));
+    if (g_uploader.initialise(TEXTURE_STAGING_SLOTS, TEXTURE_STAGING_SLOT_SIZE))
+    {
+        g_assets->set_staging([](size_t bytes, int& slot) { return g_uploader.acquire(bytes, slot); },
+                              [](int slot) { g_uploader.release(slot); });
+    }
+    GLuint baked = load_baked_texture(baked_path(g_atlas.image_path()), g_atlas.image_path(), g_atlas.mip_levels(), g_atlas_premultiplied);
+    if (baked != 0) texture_ready(ATLAS_ASSET, baked);
+    else g_assets->request(ATLAS_ASSET, g_atlas.image_path(), g_atlas.mip_levels(), g_max_texture_size);
+    for (int sprite = 0; sprite < SPRITE_COUNT; sprite++)
+    {
+        const AtlasRegion* region = g_atlas.find(SPRITE_NAMES[sprite]);
+        if (region == nullptr)
+        {
+            LOG("Sprite " << SPRITE_NAMES[sprite] << " is missing from the atlas, rebuild it.");
+            assert(false);
+        }
+        g_sprite_regions[sprite] = *region;
+    }
 
     // enable blending
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    GLState::set_blend(true, g_atlas_premultiplied ? GL_ONE : GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    return true;
 }
 
 void process_input()
 {
-    // VERY IMPORTANT: If nothing is pressed, we don't want to go anywhere
-    if (playerTwo) g_blue_movement = glm::vec3(0.0f);
-    g_pink_movement = glm::vec3(0.0f);
+    PROFILE_SCOPE("process_input");
 
     SDL_Event event;
     while (SDL_PollEvent(&event))
@@ -195,7 +428,7 @@ void process_input()
             // End game
         case SDL_QUIT:
         case SDL_WINDOWEVENT_CLOSE:
-            g_app_status = TERMINATED;
+            g_input.quit = true;
             break;
 
         case SDL_KEYDOWN:
@@ -211,17 +444,13 @@ void process_input()
                 break;
 
             case SDLK_t:
-                // Quit the game with a keystroke
-                playerTwo = !playerTwo;
-                if (!playerTwo)
-                {
-                    g_blue_movement.y = 1.0f;
-                }
+                // Toggle between two players and blue bouncing on its own
+                g_input.toggle_player_two = !g_input.toggle_player_two;
                 break;
 
             case SDLK_q:
                 // Quit the game with a keystroke
-                g_app_status = TERMINATED;
+                g_input.quit = true;
                 break;
 
             default:
@@ -236,237 +465,171 @@ void process_input()
 
     const Uint8* key_state = SDL_GetKeyboardState(NULL);
 
+    // VERY IMPORTANT: If nothing is pressed, we don't want to go anywhere
+    g_input.pink_direction = 0.0f;
+    g_input.blue_direction = 0.0f;
+
     if (key_state[SDL_SCANCODE_W])
     {
-        g_pink_movement.y = 1.0f;
+        g_input.pink_direction = 1.0f;
     }
     else if (key_state[SDL_SCANCODE_S])
     {
-        g_pink_movement.y = -1.0f;
+        g_input.pink_direction = -1.0f;
     }
 
     if (key_state[SDL_SCANCODE_UP])
     {
-        if (playerTwo)
-        { 
-			g_blue_movement.y = 1.0f;
-        }
+        g_input.blue_direction = 1.0f;
     }
     else if (key_state[SDL_SCANCODE_DOWN])
     {
-        if (playerTwo)
-        {
-            g_blue_movement.y = -1.0f;
-        }
-    }
-
-    // This makes sure that the player can't "cheat" their way into moving
-    // faster
-    if (glm::length(g_blue_movement) > 1.0f)
-    {
-        g_blue_movement = glm::normalize(g_blue_movement);
+        g_input.blue_direction = -1.0f;
     }
 }
 
-/**
- Uses distance formula.
- */
-bool check_collision(glm::vec3& position_a, glm::vec3& position_b)
-{
-    return sqrt(pow(position_b[0] - position_a[0], 2) + pow(position_b[1] - position_b[1], 2)) < MINIMUM_COLLISION_DISTANCE;
-}
-
+// Physics runs on g_simulation's thread, all we do here is hand over input and pick up its latest tick
 void update()
 {
-    float ticks = (float)SDL_GetTicks() / MILLISECONDS_IN_SECOND; // get the current number of ticks
-    float delta_time = ticks - g_previous_ticks; // the delta time is the difference from the last frame
-    g_previous_ticks = ticks;
+    PROFILE_SCOPE("update");
 
-    if (hit && hitFrames < HIT_RECOVERY)
-    {
-        hitFrames++;
-    }
-    else if (hit && hitFrames >= HIT_RECOVERY)
+    if (g_simulation.push_input(g_input))
     {
-        hitFrames = 0;
-        hit = false;
+        g_input.toggle_player_two = false;
+        g_input.quit = false;
     }
 
-    // Add direction * units per second * elapsed time
-    g_blue_position += g_blue_movement * g_blue_speed * delta_time;
-    g_pink_position += g_pink_movement * g_blue_speed * delta_time;
-    g_ball_position += g_ball_movement * g_ball_speed * delta_time;
-    g_ball_rotation.z += 1.0f * delta_time;
+    g_snapshot = &g_simulation.latest_snapshot();
 
-    g_blue_matrix = glm::mat4(1.0f);
-    g_blue_matrix = glm::translate(g_blue_matrix, g_blue_position);
-
-    g_pink_matrix = glm::mat4(1.0f);
-    g_pink_matrix = glm::translate(g_pink_matrix, g_pink_position);
-
-    g_ball_matrix = glm::mat4(1.0f);
-    g_ball_matrix = glm::translate(g_ball_matrix, g_ball_position);
-
-    g_ball_matrix = glm::rotate(g_ball_matrix,
-        g_ball_rotation.z,
-        g_ball_spin);
-
-    int collision_box_scale = 12; // restricts collision to the field side of the player, instead of a box a bar
-    float x_distance_blue = fabs(g_blue_position.x - ((collision_box_scale/2 - 2)*INIT_SCALE.x/collision_box_scale) - g_ball_position.x) - ((INIT_SCALE.x/collision_box_scale + INIT_SCALE_BALL.x) / 3.0f);
-    float y_distance_blue = fabs(g_blue_position.y - g_ball_position.y) - ((INIT_SCALE.y + INIT_SCALE_BALL.y) / 2.7f);
-    float x_distance_pink = fabs(g_pink_position.x + ((collision_box_scale/2 - 2)*INIT_SCALE.x/collision_box_scale) - g_ball_position.x) - ((INIT_SCALE.x/collision_box_scale + INIT_SCALE_BALL.x) / 2.7f);
-    float y_distance_pink = fabs(g_pink_position.y - g_ball_position.y) - ((INIT_SCALE.y + INIT_SCALE_BALL.y) / 2.7f);
-
-    // ball - blue collision
-    if (x_distance_blue < 0 && y_distance_blue < 0)
-    {
-        std::cout << std::time(nullptr) << ": Collision.\n";
-		hit = true;
-        g_ball_position.x -= 0.1f;
-        g_ball_movement.x *= -1.0f;
-        g_ball_spin *= -1.0f;
-    }
-    // ball - pink collision
-    if (x_distance_pink < 0 && y_distance_pink < 0)
-    {
-        std::cout << std::time(nullptr) << ": Collision.\n";
-		hit = true;
-        g_ball_position.x += 0.1f;
-        g_ball_movement.x *= -1.0f;
-        g_ball_spin *= -1.0f;
-    }
-    // ball - wall collision
-    if (g_ball_position.y + INIT_SCALE_BALL.y/2.4 >= 3.75f)
-    {
-		hit = true;
-        g_ball_position.y -= 0.1f;
-        g_ball_movement.y *= -1.0f;
-    } else if (g_ball_position.y - INIT_SCALE_BALL.y/2.4 <= -3.75f) {
-		hit = true;
-        g_ball_position.y += 0.1f;
-        g_ball_movement.y *= -1.0f;
-    }
-    if (g_ball_position.x - INIT_SCALE_BALL.x/2.0 >= 5.0f)
-    {
-		g_app_status = TERMINATED;
-    } else if (g_ball_position.x + INIT_SCALE_BALL.x/2.0 <= -5.0f) {
-		g_app_status = TERMINATED;
-    }
-    // blue - wall collision
-    if (g_blue_position.y + INIT_SCALE.y/3.0 >= 3.75f)
-    {
-        g_blue_position.y -= 0.1f;
-        g_blue_movement.y *= -1.0f;
-    } else if (g_blue_position.y - INIT_SCALE.y/3.0 <= -3.75f) {
-        g_blue_position.y += 0.1f;
-        g_blue_movement.y *= -1.0f;
-    }
-    // pink - wall collision
-    if (g_pink_position.y + INIT_SCALE.y/2.4 >= 3.75f)
-    {
-        g_pink_position.y -= 0.1f;
-        g_pink_movement.y *= -1.0f;
-    } else if (g_pink_position.y - INIT_SCALE.y/2.4 <= -3.75f) {
-        g_pink_position.y += 0.1f;
-        g_pink_movement.y *= -1.0f;
-    }
-    g_blue_matrix = glm::scale(g_blue_matrix, INIT_SCALE);
-    g_pink_matrix = glm::scale(g_pink_matrix, INIT_SCALE);
-    g_ball_matrix = glm::scale(g_ball_matrix, INIT_SCALE_BALL);
+    float alpha = (float)((SimulationThread::now() - g_snapshot->time) / g_snapshot->tick_length);
+    g_alpha = glm::clamp(alpha, 0.0f, 1.0f);
 }
 
-void draw_object(glm::mat4& object_model_matrix, GLuint& object_texture_id)
+// Blend between the last two physics states so motion stays smooth between ticks.
+// Every sprite comes out of the one atlas, so the batch never has to switch textures and only
+// splits the draw when it fills up.
+void draw_entities(const EntityStore& store)
 {
-    g_shader_program.set_model_matrix(object_model_matrix);
-    glBindTexture(GL_TEXTURE_2D, object_texture_id);
-    glDrawArrays(GL_TRIANGLES, 0, 6); // we are now drawing 2 triangles, so we use 6 instead of 3
+    for (size_t i = 0; i < store.size(); i++)
+    {
+        const AtlasRegion& region = g_sprite_regions[store.sprite[i]];
+
+        SpriteInstance instance;
+        instance.place(glm::mix(store.previous_x[i], store.position_x[i], g_alpha),
+                       glm::mix(store.previous_y[i], store.position_y[i], g_alpha),
+                       store.scale_x[i], store.scale_y[i],
+                       glm::mix(store.previous_rotation[i], store.rotation[i], g_alpha) * store.spin[i]);
+        instance.u0 = region.u0;
+        instance.v0 = region.v0;
+        instance.u1 = region.u1;
+        instance.v1 = region.v1;
+        instance.red = instance.green = instance.blue = instance.alpha = 255;
+
+        g_sprite_batch.add(g_atlas_texture_id, instance);
+    }
 }
 
 void render() {
-    glClear(GL_COLOR_BUFFER_BIT);
+    PROFILE_SCOPE("render");
 
-    // Vertices
-    float vertices[] = {
-        -0.5f, -0.5f, 0.5f, -0.5f, 0.5f, 0.5f,  // triangle 1
-        -0.5f, -0.5f, 0.5f, 0.5f, -0.5f, 0.5f   // triangle 2
-    };
+    upload_finished_textures();
 
-    // Textures
-    float texture_coordinates[] = {
-        0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f,     // triangle 1
-        0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f,     // triangle 2
-    };
+    glClear(GL_COLOR_BUFFER_BIT);
 
-    glVertexAttribPointer(g_shader_program.get_position_attribute(), 2, GL_FLOAT, false, 0, vertices);
-    glEnableVertexAttribArray(g_shader_program.get_position_attribute());
+    // Say everything this frame depends on, the state cache drops whatever is already set
+    GLState::use_program(g_shader_program.get_program_id());
+    GLState::set_blend(true, g_atlas_premultiplied ? GL_ONE : GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    g_camera.update(g_view_matrix, g_projection_matrix);
 
-    glVertexAttribPointer(g_shader_program.get_tex_coordinate_attribute(), 2, GL_FLOAT, false, 0, texture_coordinates);
-    glEnableVertexAttribArray(g_shader_program.get_tex_coordinate_attribute());
+    g_sprite_batch.begin();
+    draw_entities(g_snapshot->paddles);
+    draw_entities(g_snapshot->balls);
+    g_sprite_batch.end();
 
-    // Bind texture
-    draw_object(g_blue_matrix, g_blue_texture_id);
-    draw_object(g_pink_matrix, g_pink_texture_id);
-    if (!hit)
     {
-		draw_object(g_ball_matrix, g_ball_texture_id);
-    }
-    else {
-		draw_object(g_ball_matrix, g_hit_texture_id);
+        PROFILE_SCOPE("swap");
+        SDL_GL_SwapWindow(g_display_window);
     }
-
-    // We disable two attribute arrays now
-    glDisableVertexAttribArray(g_shader_program.get_position_attribute());
-    glDisableVertexAttribArray(g_shader_program.get_tex_coordinate_attribute());
-
-    SDL_GL_SwapWindow(g_display_window);
-}
-
-void shutdown() { SDL_Quit(); }
-
-#include <cmath>
-
-// Struct to represent a 2D vector or point
-struct Vec2 {
-    float x, y;
-};
-
-// Function to clamp a value between min and max, helper function to find closest point on box to circle
-float clamp(float value, float min, float max) {
-    if (value < min) return min;
-    if (value > max) return max;
-    return value;
+    GLState::end_frame();
 }
 
-// Function to check box-circle collision
-bool checkBoxCircleCollision(const glm::vec3& boxCenter, float boxWidth, float boxHeight, const glm::vec3& circleCenter, float circleRadius) {
-    // Find the closest point on the box to the circle
-    float closestX = clamp(circleCenter.x, boxCenter.x - boxWidth/2, boxCenter.x + boxWidth/2);
-    float closestY = clamp(circleCenter.y, boxCenter.y - boxHeight/2, boxCenter.y + boxHeight/2);
-
-    // Calculate the distance from the circle's center to the closest point
-    float distanceX = circleCenter.x - closestX;
-    float distanceY = circleCenter.y - closestY;
-
-    // Calculate the squared distance and compare with squared radius
-    float distanceSquared = (distanceX * distanceX) + (distanceY * distanceY);
-    float radiusSquared = circleRadius * circleRadius;
-
-    return distanceSquared <= radiusSquared;
+void shutdown()
+{
+    g_sprite_batch.shutdown();
+    g_camera.shutdown();
+
+    // the decoders may be writing into mapped staging memory or waiting on a slot, so wake
+    // them, let them finish and only then unmap it
+    g_uploader.stop();
+    g_assets.reset();
+    g_uploader.shutdown();
+    if (g_atlas_texture_id != g_placeholder_texture_id) glDeleteTextures(1, &g_atlas_texture_id);
+    glDeleteTextures(1, &g_placeholder_texture_id);
+    glDeleteBuffers(1, &g_quad_vbo);
+    GLState::invalidate();
+    SDL_Quit();
 }
 
-
-
 int main(int argc, char* argv[])
 {
-    initialise();
+    // "--balls N" starts a many-ball match, "--ball-scale S" sizes them, "--record FILE" saves it as a replay,
+    // "--replay FILE" watches one back, "--replay-speed X" fast-forwards it,
+    // "--profile NAME" writes frame timings to NAME.csv and NAME.json,
+    // "--max-texture-size N" halves textures until they fit in N x N
+    const char* replay_path = nullptr;
+    const char* profile_name = nullptr;
+    float replay_speed = 1.0f;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--balls") == 0) g_ball_count = (size_t)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ball-scale") == 0) g_ball_scale = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--record") == 0) g_simulation.record(argv[++i]);
+        else if (strcmp(argv[i], "--replay") == 0) replay_path = argv[++i];
+        else if (strcmp(argv[i], "--replay-speed") == 0) replay_speed = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--profile") == 0) profile_name = argv[++i];
+        else if (strcmp(argv[i], "--max-texture-size") == 0) g_max_texture_size = atoi(argv[++i]);
+    }
 
-    while (g_app_status == RUNNING)
+    if (replay_path != nullptr)
     {
+        if (!g_replay.load(replay_path)) return 1;
+        g_simulation.play(g_replay, replay_speed > 0.0f ? replay_speed : 1.0f);
+    }
+
+    g_startup_time = SimulationThread::now();
+    if (!initialise()) return 1;
+    LOG("Startup took " << (SimulationThread::now() - g_startup_time) * 1000.0 << " ms (shaders "
+        << g_shader_program.load_milliseconds() << " ms, "
+        << (g_shader_program.loaded_from_cache() ? "cached binary" : "compiled") << ")");
+    g_simulation.start(g_ball_count, g_ball_scale);
+    g_snapshot = &g_simulation.latest_snapshot();
+
+    while (g_snapshot->status == RUNNING)
+    {
+        PROFILE_SCOPE("frame");
         process_input();
         update();
         render();
+
+        if (GLState::frames() == 1) LOG("First frame " << (SimulationThread::now() - g_startup_time) * 1000.0 << " ms after startup");
     }
 
+    g_simulation.stop();
     shutdown();
+
+    Profiler::print_summary();
+
+    const GLState::Counters& gl_calls = GLState::total_counters();
+    if (GLState::frames() > 0)
+    {
+        LOG("GL state calls per frame: " << (double)gl_calls.issued / GLState::frames() << " issued, "
+            << (double)gl_calls.elided / GLState::frames() << " elided");
+    }
+    if (profile_name != nullptr)
+    {
+        std::string name = profile_name;
+        Profiler::export_csv((name + ".csv").c_str());
+        Profiler::export_chrome_trace((name + ".json").c_str());
+    }
     return 0;
 }
@@ -0,0 +1,29 @@
+#version 330
+
+in vec4 position;
+in vec2 texCoord;
+
+// one of each per sprite
+in vec2 instancePosition;
+in vec4 instanceAxes;    // where the quad's x and y axes end up: scale and rotation, worked out on the CPU
+in vec4 instanceUvRect;  // u0, v0, u1, v1
+in vec4 instanceTint;
+
+// shared by every program, filled in once a frame
+layout(std140) uniform Camera
+{
+    mat4 viewProjection;
+};
+
+out vec2 texCoordVar;
+out vec4 tintVar;
+
+void main()
+{
+    // same as translate * rotate * scale, without building a matrix per vertex
+    vec2 world = instancePosition + position.x * instanceAxes.xy + position.y * instanceAxes.zw;
+
+    texCoordVar = mix(instanceUvRect.xy, instanceUvRect.zw, texCoord);
+    tintVar = instanceTint;
+	gl_Position = viewProjection * vec4(world, 0.0, 1.0);
+}
@@ -42,6 +42,19 @@
    Full documentation under "DOCUMENTATION" below.
 
 
+   Local changes in this copy (keep them when updating to a newer stb_image):
+
+      - SSE2 PNG unfiltering for 8-bit RGB and RGBA rows (stbi__unfilter_row_sse2)
+      - faster inflate: 64-bit bit buffer refills, wider literal/length and distance tables
+        (stbi__zbuild_wide), 8 byte match copies, and a bounds check in the slow path
+      - PNGs inflate into one buffer of the exact size from IHDR (stbi__png_raw_size), which
+        becomes the image when it can be unfiltered in place
+      - stbi_load_into and friends: decode into caller memory at a given row pitch, with the
+        working memory from a per-call allocator (stbi_allocator, stbi__malloc/free/realloc_sized)
+      - thread safety: per-thread failure reason, stbi_set_thread_options over the global
+        settings (stbi__options), and the fixed Huffman lengths are static tables
+
+
    Revision 2.00 release notes:
 
       - Progressive JPEG is now supported.
@@ -392,6 +405,7 @@ publish, and distribute this file as you see fit.
 #ifndef STBI_NO_STDIO
 #include <stdio.h>
 #endif // STBI_NO_STDIO
+#include <stddef.h> // size_t
 
 #define STBI_VERSION 1
 
@@ -442,6 +456,30 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f,                  int *x, int *y,
 // for stbi_load_from_file, file pointer is left pointing immediately after image
 #endif
 
+// Decode into memory the caller already has, like a mapped pixel unpack buffer. Rows of
+// x*req_comp bytes go in row_pitch bytes apart, and out_size is how much room there is at
+// out (stbi_info gives the size to make). req_comp can't be 0 here. Returns 1 on success, and
+// 0 if the image is bad or doesn't fit, see stbi_failure_reason.
+//
+// out is written once per byte, top to bottom, and never read, so write-combined memory is
+// fine. The decode's own working memory comes from 'scratch' if it isn't NULL, and all of it
+// is released again before returning; nothing goes through STBI_MALLOC.
+
+typedef struct
+{
+   void *(*allocate)(void *user, size_t size);  // NULL if out of memory
+   void  (*release) (void *user, void *p);      // may be NULL, for arenas that reset in one go
+   void  *user;
+} stbi_allocator;
+
+STBIDEF int stbi_load_into               (char              const *filename,           stbi_uc *out, size_t out_size, int row_pitch, int *x, int *y, int *comp, int req_comp, stbi_allocator const *scratch);
+STBIDEF int stbi_load_from_memory_into   (stbi_uc           const *buffer, int len   , stbi_uc *out, size_t out_size, int row_pitch, int *x, int *y, int *comp, int req_comp, stbi_allocator const *scratch);
+STBIDEF int stbi_load_from_callbacks_into(stbi_io_callbacks const *clbk  , void *user, stbi_uc *out, size_t out_size, int row_pitch, int *x, int *y, int *comp, int req_comp, stbi_allocator const *scratch);
+
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_load_from_file_into     (FILE *f,                                     stbi_uc *out, size_t out_size, int row_pitch, int *x, int *y, int *comp, int req_comp, stbi_allocator const *scratch);
+#endif
+
 #ifndef STBI_NO_LINEAR
    STBIDEF float *stbi_loadf                 (char const *filename,           int *x, int *y, int *comp, int req_comp);
    STBIDEF float *stbi_loadf_from_memory     (stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
@@ -471,8 +509,7 @@ STBIDEF int      stbi_is_hdr_from_file(FILE *f);
 #endif // STBI_NO_STDIO
 
 
-// get a VERY brief reason for failure
-// NOT THREADSAFE
+// get a VERY brief reason for failure, from the last call that failed on this thread
 STBIDEF const char *stbi_failure_reason  (void);
 
 // free the loaded image -- this is just free()
@@ -502,6 +539,23 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 // flip the image vertically, so the first pixel in the output array is the bottom left
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// The setters above change process-wide defaults, which mustn't change while another thread
+// is decoding. Threads that want their own settings call stbi_set_thread_options instead:
+// it copies 'options' and everything loaded on the calling thread uses them from then on,
+// until it's called again with NULL to go back to the defaults.
+
+typedef struct
+{
+   int   flip_vertically;                     // stbi_set_flip_vertically_on_load
+   int   unpremultiply;                       // stbi_set_unpremultiply_on_load
+   int   convert_iphone_png;                  // stbi_convert_iphone_png_to_rgb
+   float hdr_to_ldr_gamma, hdr_to_ldr_scale;  // stbi_hdr_to_ldr_gamma/scale
+   float ldr_to_hdr_gamma, ldr_to_hdr_scale;  // stbi_ldr_to_hdr_gamma/scale
+} stbi_options;
+
+STBIDEF void stbi_get_default_options(stbi_options *options);
+STBIDEF void stbi_set_thread_options(stbi_options const *options);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -597,12 +651,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -642,6 +698,23 @@ typedef unsigned char validate_uint32[sizeof(stbi__uint32)==4 ? 1 : -1];
 #define STBI_REALLOC_SIZED(p,oldsz,newsz) STBI_REALLOC(p,newsz)
 #endif
 
+// Per-thread state: the failure reason, stbi_set_thread_options and stbi_load_into's
+// allocator. Without it (define STBI_THREAD_LOCAL to nothing) those are all shared, and only
+// one thread at a time should be decoding.
+#ifndef STBI_THREAD_LOCAL
+   #if defined(_MSC_VER)
+      #define STBI_THREAD_LOCAL __declspec(thread)
+   #elif defined(__cplusplus) && __cplusplus >= 201103L
+      #define STBI_THREAD_LOCAL thread_local
+   #elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+      #define STBI_THREAD_LOCAL _Thread_local
+   #elif defined(__GNUC__)
+      #define STBI_THREAD_LOCAL __thread
+   #else
+      #define STBI_THREAD_LOCAL
+   #endif
+#endif
+
 // x86/x64 detection
 #if defined(__x86_64__) || defined(_M_X64)
 #define STBI__X64_TARGET
@@ -881,8 +954,7 @@ static stbi_uc *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int
 static int      stbi__pnm_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
-// this is not threadsafe
-static const char *stbi__g_failure_reason;
+static STBI_THREAD_LOCAL const char *stbi__g_failure_reason;
 
 STBIDEF const char *stbi_failure_reason(void)
 {
@@ -895,9 +967,34 @@ static int stbi__err(const char *str)
    return 0;
 }
 
+// stbi_load_into's scratch allocator, for the length of that call on this thread. All the
+// decoders allocate through the three functions below; NULL sends them to STBI_MALLOC and co.
+static STBI_THREAD_LOCAL stbi_allocator const *stbi__scratch;
+
 static void *stbi__malloc(size_t size)
 {
-    return STBI_MALLOC(size);
+   if (stbi__scratch) return stbi__scratch->allocate(stbi__scratch->user, size);
+   return STBI_MALLOC(size);
+}
+
+static void stbi__free(void *p)
+{
+   if (!stbi__scratch) STBI_FREE(p);
+   else if (p && stbi__scratch->release) stbi__scratch->release(stbi__scratch->user, p);
+}
+
+// scratch allocators don't do realloc, so it's a fresh block and a copy there
+static void *stbi__realloc_sized(void *p, size_t oldsz, size_t newsz)
+{
+   void *q;
+   if (!stbi__scratch) return STBI_REALLOC_SIZED(p, oldsz, newsz);
+   q = stbi__malloc(newsz);
+   if (q == NULL) return NULL; // p is still good, like realloc
+   if (p) {
+      memcpy(q, p, oldsz < newsz ? oldsz : newsz);
+      stbi__free(p);
+   }
+   return q;
 }
 
 // stbi__err - error
@@ -928,11 +1025,30 @@ static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp);
 static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp);
 #endif
 
-static int stbi__vertically_flip_on_load = 0;
+static stbi_options stbi__default_options = { 0, 0, 0, 2.2f, 1.0f, 2.2f, 1.0f };
+static STBI_THREAD_LOCAL stbi_options stbi__thread_options;
+static STBI_THREAD_LOCAL int stbi__thread_options_set;
+
+// what the calling thread decodes with
+static stbi_options const *stbi__options(void)
+{
+   return stbi__thread_options_set ? &stbi__thread_options : &stbi__default_options;
+}
+
+STBIDEF void stbi_get_default_options(stbi_options *options)
+{
+   *options = stbi__default_options;
+}
+
+STBIDEF void stbi_set_thread_options(stbi_options const *options)
+{
+   if (options) stbi__thread_options = *options;
+   stbi__thread_options_set = options != NULL;
+}
 
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
 {
-    stbi__vertically_flip_on_load = flag_true_if_should_flip;
+    stbi__default_options.flip_vertically = flag_true_if_should_flip;
 }
 
 static unsigned char *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp)
@@ -979,7 +1095,7 @@ static unsigned char *stbi__load_flip(stbi__context *s, int *x, int *y, int *com
 {
    unsigned char *result = stbi__load_main(s, x, y, comp, req_comp);
 
-   if (stbi__vertically_flip_on_load && result != NULL) {
+   if (stbi__options()->flip_vertically && result != NULL) {
       int w = *x, h = *y;
       int depth = req_comp ? req_comp : *comp;
       int row,col,z;
@@ -1000,10 +1116,40 @@ static unsigned char *stbi__load_flip(stbi__context *s, int *x, int *y, int *com
    return result;
 }
 
+// Decodes into scratch memory as usual, then streams the rows out to their place in 'out',
+// flipping on the way if asked to, rather than flipping in place first
+static int stbi__load_into(stbi__context *s, stbi_uc *out, size_t out_size, int row_pitch, int *x, int *y, int *comp, int req_comp, stbi_allocator const *scratch)
+{
+   stbi_allocator const *outer = stbi__scratch;
+   unsigned char *result;
+   int ok = 0;
+
+   if (req_comp < 1 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+   stbi__scratch = scratch;
+   result = stbi__load_main(s, x, y, comp, req_comp);
+   if (result) {
+      size_t row_bytes = (size_t) *x * req_comp;
+      if (row_pitch < 0 || (size_t) row_pitch < row_bytes || out_size < row_bytes
+          || (size_t) (*y - 1) > (out_size - row_bytes) / (size_t) row_pitch) {
+         stbi__err("too small", "Image doesn't fit in the destination");
+      } else {
+         int row, flip = stbi__options()->flip_vertically;
+         for (row = 0; row < *y; ++row) {
+            int from = flip ? *y - 1 - row : row;
+            memcpy(out + (size_t) row * row_pitch, result + (size_t) from * row_bytes, row_bytes);
+         }
+         ok = 1;
+      }
+      stbi__free(result);
+   }
+   stbi__scratch = outer;
+   return ok;
+}
+
 #ifndef STBI_NO_HDR
 static void stbi__float_postprocess(float *result, int *x, int *y, int *comp, int req_comp)
 {
-   if (stbi__vertically_flip_on_load && result != NULL) {
+   if (stbi__options()->flip_vertically && result != NULL) {
       int w = *x, h = *y;
       int depth = req_comp ? req_comp : *comp;
       int row,col,z;
@@ -1060,6 +1206,29 @@ STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req
    }
    return result;
 }
+
+STBIDEF int stbi_load_into(char const *filename, stbi_uc *out, size_t out_size, int row_pitch, int *x, int *y, int *comp, int req_comp, stbi_allocator const *scratch)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   int result;
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   result = stbi_load_from_file_into(f,out,out_size,row_pitch,x,y,comp,req_comp,scratch);
+   fclose(f);
+   return result;
+}
+
+STBIDEF int stbi_load_from_file_into(FILE *f, stbi_uc *out, size_t out_size, int row_pitch, int *x, int *y, int *comp, int req_comp, stbi_allocator const *scratch)
+{
+   int result;
+   stbi__context s;
+   stbi__start_file(&s,f);
+   result = stbi__load_into(&s,out,out_size,row_pitch,x,y,comp,req_comp,scratch);
+   if (result) {
+      // need to 'unget' all the characters in the IO buffer
+      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   }
+   return result;
+}
 #endif //!STBI_NO_STDIO
 
 STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
@@ -1076,6 +1245,20 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_flip(&s,x,y,comp,req_comp);
 }
 
+STBIDEF int stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *out, size_t out_size, int row_pitch, int *x, int *y, int *comp, int req_comp, stbi_allocator const *scratch)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_into(&s,out,out_size,row_pitch,x,y,comp,req_comp,scratch);
+}
+
+STBIDEF int stbi_load_from_callbacks_into(stbi_io_callbacks const *clbk, void *user, stbi_uc *out, size_t out_size, int row_pitch, int *x, int *y, int *comp, int req_comp, stbi_allocator const *scratch)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__load_into(&s,out,out_size,row_pitch,x,y,comp,req_comp,scratch);
+}
+
 #ifndef STBI_NO_LINEAR
 static float *stbi__loadf_main(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
@@ -1185,16 +1368,12 @@ STBIDEF int      stbi_is_hdr_from_callbacks(stbi_io_callbacks const *clbk, void
 }
 
 #ifndef STBI_NO_LINEAR
-static float stbi__l2h_gamma=2.2f, stbi__l2h_scale=1.0f;
-
-STBIDEF void   stbi_ldr_to_hdr_gamma(float gamma) { stbi__l2h_gamma = gamma; }
-STBIDEF void   stbi_ldr_to_hdr_scale(float scale) { stbi__l2h_scale = scale; }
+STBIDEF void   stbi_ldr_to_hdr_gamma(float gamma) { stbi__default_options.ldr_to_hdr_gamma = gamma; }
+STBIDEF void   stbi_ldr_to_hdr_scale(float scale) { stbi__default_options.ldr_to_hdr_scale = scale; }
 #endif
 
-static float stbi__h2l_gamma_i=1.0f/2.2f, stbi__h2l_scale_i=1.0f;
-
-STBIDEF void   stbi_hdr_to_ldr_gamma(float gamma) { stbi__h2l_gamma_i = 1/gamma; }
-STBIDEF void   stbi_hdr_to_ldr_scale(float scale) { stbi__h2l_scale_i = 1/scale; }
+STBIDEF void   stbi_hdr_to_ldr_gamma(float gamma) { stbi__default_options.hdr_to_ldr_gamma = gamma; }
+STBIDEF void   stbi_hdr_to_ldr_scale(float scale) { stbi__default_options.hdr_to_ldr_scale = scale; }
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1348,7 +1527,7 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
 
    good = (unsigned char *) stbi__malloc(req_comp * x * y);
    if (good == NULL) {
-      STBI_FREE(data);
+      stbi__free(data);
       return stbi__errpuc("outofmem", "Out of memory");
    }
 
@@ -1378,7 +1557,7 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
       #undef CASE
    }
 
-   STBI_FREE(data);
+   stbi__free(data);
    return good;
 }
 
@@ -1386,17 +1565,18 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
 static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 {
    int i,k,n;
+   float gamma = stbi__options()->ldr_to_hdr_gamma, scale = stbi__options()->ldr_to_hdr_scale;
    float *output = (float *) stbi__malloc(x * y * comp * sizeof(float));
-   if (output == NULL) { STBI_FREE(data); return stbi__errpf("outofmem", "Out of memory"); }
+   if (output == NULL) { stbi__free(data); return stbi__errpf("outofmem", "Out of memory"); }
    // compute number of non-alpha components
    if (comp & 1) n = comp; else n = comp-1;
    for (i=0; i < x*y; ++i) {
       for (k=0; k < n; ++k) {
-         output[i*comp + k] = (float) (pow(data[i*comp+k]/255.0f, stbi__l2h_gamma) * stbi__l2h_scale);
+         output[i*comp + k] = (float) (pow(data[i*comp+k]/255.0f, gamma) * scale);
       }
       if (k < comp) output[i*comp + k] = data[i*comp+k]/255.0f;
    }
-   STBI_FREE(data);
+   stbi__free(data);
    return output;
 }
 #endif
@@ -1406,13 +1586,14 @@ static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 {
    int i,k,n;
+   float gamma_i = 1/stbi__options()->hdr_to_ldr_gamma, scale_i = 1/stbi__options()->hdr_to_ldr_scale;
    stbi_uc *output = (stbi_uc *) stbi__malloc(x * y * comp);
-   if (output == NULL) { STBI_FREE(data); return stbi__errpuc("outofmem", "Out of memory"); }
+   if (output == NULL) { stbi__free(data); return stbi__errpuc("outofmem", "Out of memory"); }
    // compute number of non-alpha components
    if (comp & 1) n = comp; else n = comp-1;
    for (i=0; i < x*y; ++i) {
       for (k=0; k < n; ++k) {
-         float z = (float) pow(data[i*comp+k]*stbi__h2l_scale_i, stbi__h2l_gamma_i) * 255 + 0.5f;
+         float z = (float) pow(data[i*comp+k]*scale_i, gamma_i) * 255 + 0.5f;
          if (z < 0) z = 0;
          if (z > 255) z = 255;
          output[i*comp + k] = (stbi_uc) stbi__float2int(z);
@@ -1424,7 +1605,7 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
          output[i*comp + k] = (stbi_uc) stbi__float2int(z);
       }
    }
-   STBI_FREE(data);
+   stbi__free(data);
    return output;
 }
 #endif
@@ -2767,7 +2948,7 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
 
       if (z->img_comp[i].raw_data == NULL) {
          for(--i; i >= 0; --i) {
-            STBI_FREE(z->img_comp[i].raw_data);
+            stbi__free(z->img_comp[i].raw_data);
             z->img_comp[i].raw_data = NULL;
          }
          return stbi__err("outofmem", "Out of memory");
@@ -2778,7 +2959,7 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       if (z->progressive) {
          z->img_comp[i].coeff_w = (z->img_comp[i].w2 + 7) >> 3;
          z->img_comp[i].coeff_h = (z->img_comp[i].h2 + 7) >> 3;
-         z->img_comp[i].raw_coeff = STBI_MALLOC(z->img_comp[i].coeff_w * z->img_comp[i].coeff_h * 64 * sizeof(short) + 15);
+         z->img_comp[i].raw_coeff = stbi__malloc(z->img_comp[i].coeff_w * z->img_comp[i].coeff_h * 64 * sizeof(short) + 15);
          z->img_comp[i].coeff = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
       } else {
          z->img_comp[i].coeff = 0;
@@ -3291,17 +3472,17 @@ static void stbi__cleanup_jpeg(stbi__jpeg *j)
    int i;
    for (i=0; i < j->s->img_n; ++i) {
       if (j->img_comp[i].raw_data) {
-         STBI_FREE(j->img_comp[i].raw_data);
+         stbi__free(j->img_comp[i].raw_data);
          j->img_comp[i].raw_data = NULL;
          j->img_comp[i].data = NULL;
       }
       if (j->img_comp[i].raw_coeff) {
-         STBI_FREE(j->img_comp[i].raw_coeff);
+         stbi__free(j->img_comp[i].raw_coeff);
          j->img_comp[i].raw_coeff = 0;
          j->img_comp[i].coeff = 0;
       }
       if (j->img_comp[i].linebuf) {
-         STBI_FREE(j->img_comp[i].linebuf);
+         stbi__free(j->img_comp[i].linebuf);
          j->img_comp[i].linebuf = NULL;
       }
    }
@@ -3431,7 +3612,7 @@ static unsigned char *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *com
    j->s = s;
    stbi__setup_jpeg(j);
    result = load_jpeg_image(j, x,y,comp,req_comp);
-   STBI_FREE(j);
+   stbi__free(j);
    return result;
 }
 
@@ -3464,7 +3645,7 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
    stbi__jpeg* j = (stbi__jpeg*) (stbi__malloc(sizeof(stbi__jpeg)));
    j->s = s;
    result = stbi__jpeg_info_raw(j, x, y, comp);
-   STBI_FREE(j);
+   stbi__free(j);
    return result;
 }
 #endif
@@ -3482,6 +3663,25 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 
+// The literal/length and distance codes of a block also get a wider table, where each entry
+// is everything one lookup can resolve: up to two literals, or a length or distance with its
+// extra bits already added when they fit in the same STBI__ZWIDE_BITS. Longer codes still go
+// through stbi__zhuffman_decode_slowpath.
+//
+//    bits  0-4   bits the entry consumes
+//    bits  5-6   kind, one of STBI__ZWIDE_SLOW..STBI__ZWIDE_END
+//    bit   7     literals: there's a second one
+//    bits  8-15  literals: the first; values: extra bits still to read
+//    bits 16-23  literals: the second
+//    bits 16-31  values: the length or distance, or its base if extra bits are left
+#define STBI__ZWIDE_BITS     10
+#define STBI__ZWIDE_MASK     ((1 << STBI__ZWIDE_BITS) - 1)
+#define STBI__ZWIDE_SLOW     0
+#define STBI__ZWIDE_LITERAL  1
+#define STBI__ZWIDE_VALUE    2
+#define STBI__ZWIDE_END      3
+#define STBI__ZWIDE_KIND(e)  (((e) >> 5) & 3)
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -3511,7 +3711,7 @@ stbi_inline static int stbi__bit_reverse(int v, int bits)
    return stbi__bitreverse16(v) >> (16-bits);
 }
 
-static int stbi__zbuild_huffman(stbi__zhuffman *z, stbi_uc *sizelist, int num)
+static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int num)
 {
    int i,k=0;
    int code, next_code[16], sizes[17];
@@ -3567,8 +3767,9 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, stbi_uc *sizelist, int num)
 typedef struct
 {
    stbi_uc *zbuffer, *zbuffer_end;
+   int zbuffer_overrun; // zero bytes handed out past zbuffer_end
    int num_bits;
-   stbi__uint32 code_buffer;
+   stbi__uint64 code_buffer;
 
    char *zout;
    char *zout_start;
@@ -3576,28 +3777,63 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
+   stbi__uint32 z_length_wide[1 << STBI__ZWIDE_BITS], z_distance_wide[1 << STBI__ZWIDE_BITS];
 } stbi__zbuf;
 
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
 {
-   if (z->zbuffer >= z->zbuffer_end) return 0;
+   if (z->zbuffer >= z->zbuffer_end) {
+      ++z->zbuffer_overrun;
+      return 0;
+   }
    return *z->zbuffer++;
 }
 
 static void stbi__fill_bits(stbi__zbuf *z)
 {
    do {
-      STBI_ASSERT(z->code_buffer < (1U << z->num_bits));
-      z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
+      STBI_ASSERT(z->code_buffer < ((stbi__uint64) 1 << z->num_bits));
+      z->code_buffer |= (stbi__uint64) stbi__zget8(z) << z->num_bits;
       z->num_bits += 8;
    } while (z->num_bits <= 24);
 }
 
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc *p)
+{
+#if defined(STBI__X86_TARGET) || defined(STBI__X64_TARGET)
+   stbi__uint64 v;
+   memcpy(&v, p, 8);
+   return v;
+#else
+   return (stbi__uint64) p[0]       | (stbi__uint64) p[1] <<  8 | (stbi__uint64) p[2] << 16 | (stbi__uint64) p[3] << 24 |
+          (stbi__uint64) p[4] << 32 | (stbi__uint64) p[5] << 40 | (stbi__uint64) p[6] << 48 | (stbi__uint64) p[7] << 56;
+#endif
+}
+
+// Tops the bit buffer up to at least 49 bits, enough for the longest length and distance
+// pair with all their extra bits. A word at a time while 8 bytes of input are left, then a
+// byte at a time.
+stbi_inline static void stbi__zrefill(stbi__zbuf *z)
+{
+   if (z->zbuffer_end - z->zbuffer >= 8) {
+      int bytes = (63 - z->num_bits) >> 3;
+      z->code_buffer |= stbi__zload64(z->zbuffer) << z->num_bits;
+      z->zbuffer  += bytes;
+      z->num_bits += bytes * 8;
+      z->code_buffer &= ((stbi__uint64) 1 << z->num_bits) - 1; // drop the bits of the byte that didn't fit
+   } else {
+      while (z->num_bits <= 48) {
+         z->code_buffer |= (stbi__uint64) stbi__zget8(z) << z->num_bits;
+         z->num_bits += 8;
+      }
+   }
+}
+
 stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
 {
    unsigned int k;
    if (z->num_bits < n) stbi__fill_bits(z);
-   k = z->code_buffer & ((1 << n) - 1);
+   k = (unsigned int) (z->code_buffer & ((1 << n) - 1));
    z->code_buffer >>= n;
    z->num_bits -= n;
    return k;
@@ -3608,14 +3844,14 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse((int) (a->code_buffer & 0xffff), 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
    if (s == 16) return -1; // invalid code!
    // code size is s, so:
    b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
-   STBI_ASSERT(z->size[b] == s);
+   if (b < 0 || b >= 288 || z->size[b] != s) return -1; // bits that aren't any code in an incomplete set
    a->code_buffer >>= s;
    a->num_bits -= s;
    return z->value[b];
@@ -3645,7 +3881,7 @@ static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room
    limit = old_limit = (int) (z->zout_end - z->zout_start);
    while (cur + n > limit)
       limit *= 2;
-   q = (char *) STBI_REALLOC_SIZED(z->zout_start, old_limit, limit);
+   q = (char *) stbi__realloc_sized(z->zout_start, old_limit, limit);
    STBI_NOTUSED(old_limit);
    if (q == NULL) return stbi__err("outofmem", "Out of memory");
    z->zout_start = q;
@@ -3668,44 +3904,170 @@ static int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,
 static int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+// sizelist as for stbi__zbuild_huffman, which must have accepted it already
+static void stbi__zbuild_wide(stbi__uint32 *wide, const stbi_uc *sizelist, int num, int lengths)
+{
+   int i,j;
+   int code, next_code[16], sizes[16], shortest_literal = 16;
+
+   memset(sizes, 0, sizeof(sizes));
+   memset(wide, 0, sizeof(stbi__uint32) << STBI__ZWIDE_BITS);
+   for (i=0; i < num; ++i)
+      ++sizes[sizelist[i]];
+   sizes[0] = 0;
+   code = 0;
+   for (i=1; i < 16; ++i) {
+      next_code[i] = code;
+      code = (code + sizes[i]) << 1;
+   }
+   for (i=0; i < num; ++i) {
+      int s = sizelist[i];
+      if (!s) continue;
+      if (s <= STBI__ZWIDE_BITS) {
+         int z = lengths ? i - 257 : i;
+         int extra = 0, step = 1 << s;
+         stbi__uint32 e = 0; // symbols past the end of the spec's tables stay on the slow path, which rejects them
+         j = stbi__bit_reverse(next_code[s],s);
+         if (lengths && i < 256) {
+            e = (stbi__uint32) (s | (STBI__ZWIDE_LITERAL << 5) | (i << 8));
+            if (s < shortest_literal) shortest_literal = s;
+         } else if (lengths && i == 256)
+            e = (stbi__uint32) (s | (STBI__ZWIDE_END << 5));
+         else if (z < (lengths ? 29 : 30)) {
+            int base = lengths ? stbi__zlength_base[z] : stbi__zdist_base[z];
+            extra = lengths ? stbi__zlength_extra[z] : stbi__zdist_extra[z];
+            if (s + extra <= STBI__ZWIDE_BITS) {
+               // the extra bits fit too: one run of entries per value they can take
+               int v;
+               for (v=0; v < (1 << extra); ++v) {
+                  stbi__uint32 ev = (stbi__uint32) (s + extra) | (STBI__ZWIDE_VALUE << 5) | ((stbi__uint32) (base + v) << 16);
+                  int k;
+                  for (k = j | (v << s); k < (1 << STBI__ZWIDE_BITS); k += step << extra)
+                     wide[k] = ev;
+               }
+               ++next_code[s];
+               continue;
+            }
+            e = (stbi__uint32) s | (STBI__ZWIDE_VALUE << 5) | (extra << 8) | ((stbi__uint32) base << 16);
+         }
+         for (; j < (1 << STBI__ZWIDE_BITS); j += step)
+            wide[j] = e;
+      }
+      ++next_code[s];
+   }
+
+   // pair up literals whose codes fit in one lookup together. Going downwards, the entry for
+   // the bits after the first literal (j >> s, never above j) is still a single one when read.
+   // No two fit in fixed blocks or ones with a flat spread of literals, skip those.
+   if (lengths && shortest_literal * 2 <= STBI__ZWIDE_BITS) {
+      for (j = (1 << STBI__ZWIDE_BITS) - 1; j >= 0; --j) {
+         stbi__uint32 first = wide[j], second;
+         int s = first & 31;
+         if (STBI__ZWIDE_KIND(first) != STBI__ZWIDE_LITERAL || s >= STBI__ZWIDE_BITS) continue;
+         second = wide[j >> s];
+         if (STBI__ZWIDE_KIND(second) == STBI__ZWIDE_LITERAL && !(second & 0x80) && s + (int) (second & 31) <= STBI__ZWIDE_BITS)
+            wide[j] = (first + (second & 31)) | 0x80 | ((second & 0xff00) << 8);
+      }
+   }
+}
+
+// A code too long for the wide table, decoded the old way and made into an entry with
+// nothing left to consume but its extra bits. Zero for a bad code.
+static stbi__uint32 stbi__zwide_slowpath(stbi__zbuf *a, stbi__zhuffman *z, int lengths)
+{
+   int s = stbi__zhuffman_decode_slowpath(a, z);
+   if (s < 0) return 0;
+   if (lengths) {
+      if (s < 256) return (stbi__uint32) (STBI__ZWIDE_LITERAL << 5) | (s << 8);
+      if (s == 256) return STBI__ZWIDE_END << 5;
+      s -= 257;
+      if (s >= 29) return 0;
+      return (stbi__uint32) (STBI__ZWIDE_VALUE << 5) | (stbi__zlength_extra[s] << 8) | ((stbi__uint32) stbi__zlength_base[s] << 16);
+   }
+   if (s >= 30) return 0;
+   return (stbi__uint32) (STBI__ZWIDE_VALUE << 5) | (stbi__zdist_extra[s] << 8) | ((stbi__uint32) stbi__zdist_base[s] << 16);
+}
+
+stbi_inline static int stbi__zwide_value(stbi__zbuf *a, stbi__uint32 e)
+{
+   int extra = (e >> 8) & 31;
+   int v = (int) (e >> 16);
+   if (extra) {
+      v += (int) (a->code_buffer & ((1 << extra) - 1));
+      a->code_buffer >>= extra;
+      a->num_bits -= extra;
+   }
+   return v;
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
-      if (z < 256) {
-         if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
-         if (zout >= a->zout_end) {
-            if (!stbi__zexpand(a, zout, 1)) return 0;
-            zout = a->zout;
-         }
-         *zout++ = (char) z;
-      } else {
-         stbi_uc *p;
-         int len,dist;
-         if (z == 256) {
-            a->zout = zout;
-            return 1;
-         }
-         z -= 257;
-         len = stbi__zlength_base[z];
-         if (stbi__zlength_extra[z]) len += stbi__zreceive(a, stbi__zlength_extra[z]);
-         z = stbi__zhuffman_decode(a, &a->z_distance);
-         if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
-         dist = stbi__zdist_base[z];
-         if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
-         if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
-         if (zout + len > a->zout_end) {
-            if (!stbi__zexpand(a, zout, len)) return 0;
+      stbi_uc *p;
+      stbi__uint32 e;
+      int len,dist;
+      if (a->num_bits < 48) stbi__zrefill(a);
+      e = a->z_length_wide[a->code_buffer & STBI__ZWIDE_MASK];
+      if (STBI__ZWIDE_KIND(e) == STBI__ZWIDE_SLOW) {
+         e = stbi__zwide_slowpath(a, &a->z_length, 1);
+         if (!e) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
+      }
+      a->code_buffer >>= e & 31;
+      a->num_bits -= e & 31;
+
+      if (STBI__ZWIDE_KIND(e) == STBI__ZWIDE_LITERAL) {
+         int count = (e & 0x80) ? 2 : 1;
+         if (a->zout_end - zout < count) {
+            if (!stbi__zexpand(a, zout, count)) return 0;
             zout = a->zout;
          }
-         p = (stbi_uc *) (zout - dist);
-         if (dist == 1) { // run of one byte; common in images.
-            stbi_uc v = *p;
-            if (len) { do *zout++ = v; while (--len); }
-         } else {
-            if (len) { do *zout++ = *p++; while (--len); }
+         *zout++ = (char) (e >> 8);
+         if (count == 2) *zout++ = (char) (e >> 16);
+         continue;
+      }
+      if (STBI__ZWIDE_KIND(e) == STBI__ZWIDE_END) {
+         a->zout = zout;
+         return 1;
+      }
+      len = stbi__zwide_value(a, e);
+
+      e = a->z_distance_wide[a->code_buffer & STBI__ZWIDE_MASK];
+      if (STBI__ZWIDE_KIND(e) == STBI__ZWIDE_SLOW) {
+         e = stbi__zwide_slowpath(a, &a->z_distance, 0);
+         if (!e) return stbi__err("bad huffman code","Corrupt PNG");
+      }
+      a->code_buffer >>= e & 31;
+      a->num_bits -= e & 31;
+      dist = stbi__zwide_value(a, e);
+
+      if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
+      if (a->zout_end - zout < len) {
+         if (!stbi__zexpand(a, zout, len)) return 0;
+         zout = a->zout;
+      }
+      p = (stbi_uc *) (zout - dist);
+      if (dist == 1) { // run of one byte; common in images.
+         memset(zout, *p, len);
+         zout += len;
+      } else if (a->zout_end - zout >= len + 8) {
+         // 8 bytes at a time, the last word running up to 7 bytes past the match into space
+         // nothing's been written to yet. A source closer than 8 bytes would overlap what the
+         // word writes, so those start with 8 single bytes and then copy whole words from the
+         // nearest multiple of the distance at least 8 back, which repeats the same bytes.
+         char *end = zout + len;
+         int back = dist;
+         if (dist < 8) {
+            int i;
+            for (i=0; i < 8; ++i) zout[i] = (char) p[i];
+            zout += 8;
+            back = (8 + dist - 1) / dist * dist;
          }
+         for (; zout < end; zout += 8)
+            memcpy(zout, zout - back, 8);
+         zout = end;
+      } else {
+         do *zout++ = *p++; while (--len);
       }
    }
 }
@@ -3753,6 +4115,8 @@ static int stbi__compute_huffman_codes(stbi__zbuf *a)
    if (n != hlit+hdist) return stbi__err("bad codelengths","Corrupt PNG");
    if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit)) return 0;
    if (!stbi__zbuild_huffman(&a->z_distance, lencodes+hlit, hdist)) return 0;
+   stbi__zbuild_wide(a->z_length_wide, lencodes, hlit, 1);
+   stbi__zbuild_wide(a->z_distance_wide, lencodes+hlit, hdist, 0);
    return 1;
 }
 
@@ -3764,12 +4128,19 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
       stbi__zreceive(a, a->num_bits & 7); // discard
    // drain the bit-packed data into header
    k = 0;
-   while (a->num_bits > 0) {
+   while (a->num_bits > 0 && k < 4) {
       header[k++] = (stbi_uc) (a->code_buffer & 255); // suppress MSVC run-time check
       a->code_buffer >>= 8;
       a->num_bits -= 8;
    }
-   STBI_ASSERT(a->num_bits == 0);
+   // word refills can read past the header, put those bytes back (the ones that came out of
+   // zbuffer, not the zeros past its end)
+   if (a->num_bits > 0) {
+      int ahead = (a->num_bits >> 3) - a->zbuffer_overrun;
+      if (ahead > 0) a->zbuffer -= ahead;
+      a->code_buffer = 0;
+      a->num_bits = 0;
+   }
    // now fill header the normal way
    while (k < 4)
       header[k++] = stbi__zget8(a);
@@ -3798,22 +4169,29 @@ static int stbi__parse_zlib_header(stbi__zbuf *a)
    return 1;
 }
 
-// @TODO: should statically initialize these for optimal thread safety
-static stbi_uc stbi__zdefault_length[288], stbi__zdefault_distance[32];
-static void stbi__init_zdefaults(void)
+// fixed Huffman code lengths: 0-143 are 8 bits, 144-255 are 9, 256-279 are 7, 280-287 are 8.
+// Spelled out rather than filled in on first use, so threads can't race to fill them.
+static const stbi_uc stbi__zdefault_length[288] =
 {
-   int i;   // use <= to match clearly with spec
-   for (i=0; i <= 143; ++i)     stbi__zdefault_length[i]   = 8;
-   for (   ; i <= 255; ++i)     stbi__zdefault_length[i]   = 9;
-   for (   ; i <= 279; ++i)     stbi__zdefault_length[i]   = 7;
-   for (   ; i <= 287; ++i)     stbi__zdefault_length[i]   = 8;
-
-   for (i=0; i <=  31; ++i)     stbi__zdefault_distance[i] = 5;
-}
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8, 8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8, 8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8, 8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8, 8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8, 9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9, 9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9, 9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9, 9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7, 7,7,7,7,7,7,7,7,8,8,8,8,8,8,8,8
+};
+static const stbi_uc stbi__zdefault_distance[32] =
+{
+   5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5, 5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5
+};
 
 static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
 {
    int final, type;
+   a->zbuffer_overrun = 0;
    if (parse_header)
       if (!stbi__parse_zlib_header(a)) return 0;
    a->num_bits = 0;
@@ -3828,9 +4206,10 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
       } else {
          if (type == 1) {
             // use fixed code lengths
-            if (!stbi__zdefault_distance[31]) stbi__init_zdefaults();
             if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , 288)) return 0;
             if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32)) return 0;
+            stbi__zbuild_wide(a->z_length_wide  , stbi__zdefault_length  , 288, 1);
+            stbi__zbuild_wide(a->z_distance_wide, stbi__zdefault_distance,  32, 0);
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
@@ -3861,7 +4240,7 @@ STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
    } else {
-      STBI_FREE(a.zout_start);
+      stbi__free(a.zout_start);
       return NULL;
    }
 }
@@ -3882,7 +4261,7 @@ STBIDEF char *stbi_zlib_decode_malloc_guesssize_headerflag(const char *buffer, i
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
    } else {
-      STBI_FREE(a.zout_start);
+      stbi__free(a.zout_start);
       return NULL;
    }
 }
@@ -3909,7 +4288,7 @@ STBIDEF char *stbi_zlib_decode_noheader_malloc(char const *buffer, int len, int
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
    } else {
-      STBI_FREE(a.zout_start);
+      stbi__free(a.zout_start);
       return NULL;
    }
 }
@@ -4001,6 +4380,122 @@ static int stbi__paeth(int a, int b, int c)
 
 static stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#ifdef STBI_SSE2
+// SSE2 versions of the 8-bit filters for 3 and 4 byte pixels, after the first pixel of the row.
+// Up has no dependency along the row so it goes 16 bytes at a time. Sub, Avg and Paeth all need
+// the pixel just decoded, so they go a pixel at a time with the pixel's bytes in parallel (and
+// Sub with 4 byte pixels does 4 at a time with a prefix sum). Same approach as libpng's.
+
+static __m128i stbi__png_load_pixel(const stbi_uc *p, int bpp)
+{
+   int v = 0;
+   memcpy(&v, p, bpp);
+   return _mm_cvtsi32_si128(v);
+}
+
+static void stbi__png_store_pixel(stbi_uc *p, __m128i v, int bpp)
+{
+   int w = _mm_cvtsi128_si32(v);
+   memcpy(p, &w, bpp);
+}
+
+static void stbi__unfilter_up_sse2(stbi_uc *cur, stbi_uc *prior, stbi_uc *raw, int n)
+{
+   int k = 0;
+   for (; k + 16 <= n; k += 16) {
+      __m128i r = _mm_loadu_si128((const __m128i *) (raw + k));
+      __m128i p = _mm_loadu_si128((const __m128i *) (prior + k));
+      _mm_storeu_si128((__m128i *) (cur + k), _mm_add_epi8(r, p));
+   }
+   for (; k < n; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+
+static void stbi__unfilter_sub_sse2(stbi_uc *cur, stbi_uc *raw, int n, int bpp)
+{
+   int k = 0;
+   __m128i a = stbi__png_load_pixel(cur - bpp, bpp);
+   if (bpp == 4) {
+      // each lane adds in every lane before it, then the last pixel of the previous group
+      a = _mm_shuffle_epi32(a, 0x00);
+      for (; k + 16 <= n; k += 16) {
+         __m128i d = _mm_loadu_si128((const __m128i *) (raw + k));
+         d = _mm_add_epi8(d, _mm_slli_si128(d, 4));
+         d = _mm_add_epi8(d, _mm_slli_si128(d, 8));
+         d = _mm_add_epi8(d, a);
+         _mm_storeu_si128((__m128i *) (cur + k), d);
+         a = _mm_shuffle_epi32(d, 0xff);
+      }
+   }
+   for (; k < n; k += bpp) {
+      a = _mm_add_epi8(a, stbi__png_load_pixel(raw + k, bpp));
+      stbi__png_store_pixel(cur + k, a, bpp);
+   }
+}
+
+static void stbi__unfilter_avg_sse2(stbi_uc *cur, stbi_uc *prior, stbi_uc *raw, int n, int bpp)
+{
+   int k;
+   __m128i a = stbi__png_load_pixel(cur - bpp, bpp);
+   __m128i ones = _mm_set1_epi8(1);
+   for (k = 0; k < n; k += bpp) {
+      __m128i b = stbi__png_load_pixel(prior + k, bpp);
+      // _mm_avg_epu8 rounds up, PNG rounds down, so take the odd bit back off
+      __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), ones));
+      a = _mm_add_epi8(avg, stbi__png_load_pixel(raw + k, bpp));
+      stbi__png_store_pixel(cur + k, a, bpp);
+   }
+}
+
+static __m128i stbi__abs_epi16(__m128i x)
+{
+   return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static __m128i stbi__select(__m128i mask, __m128i yes, __m128i no)
+{
+   return _mm_or_si128(_mm_and_si128(mask, yes), _mm_andnot_si128(mask, no));
+}
+
+static void stbi__unfilter_paeth_sse2(stbi_uc *cur, stbi_uc *prior, stbi_uc *raw, int n, int bpp)
+{
+   int k;
+   __m128i zero = _mm_setzero_si128();
+   __m128i a = _mm_unpacklo_epi8(stbi__png_load_pixel(cur - bpp, bpp), zero);
+   __m128i c = _mm_unpacklo_epi8(stbi__png_load_pixel(prior - bpp, bpp), zero);
+   for (k = 0; k < n; k += bpp) {
+      __m128i b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior + k, bpp), zero);
+      // p = a + b - c, so p - a = b - c, p - b = a - c and p - c = the two added
+      __m128i pa = _mm_sub_epi16(b, c);
+      __m128i pb = _mm_sub_epi16(a, c);
+      __m128i pc = stbi__abs_epi16(_mm_add_epi16(pa, pb));
+      __m128i smallest, nearest, d;
+      pa = stbi__abs_epi16(pa);
+      pb = stbi__abs_epi16(pb);
+      smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+      // same tie breaking as stbi__paeth: a, then b, then c
+      nearest = stbi__select(_mm_cmpeq_epi16(smallest, pa), a, stbi__select(_mm_cmpeq_epi16(smallest, pb), b, c));
+      d = _mm_add_epi8(_mm_packus_epi16(nearest, nearest), stbi__png_load_pixel(raw + k, bpp));
+      stbi__png_store_pixel(cur + k, d, bpp);
+      a = _mm_unpacklo_epi8(d, zero);
+      c = b;
+   }
+}
+
+// 0 if there's no SIMD version of this filter and the scalar loop should do it
+static int stbi__unfilter_row_sse2(int filter, stbi_uc *cur, stbi_uc *prior, stbi_uc *raw, int n, int bpp)
+{
+   switch (filter) {
+      case STBI__F_sub  : stbi__unfilter_sub_sse2(cur, raw, n, bpp); return 1;
+      case STBI__F_up   : stbi__unfilter_up_sse2(cur, prior, raw, n); return 1;
+      case STBI__F_avg  : stbi__unfilter_avg_sse2(cur, prior, raw, n, bpp); return 1;
+      case STBI__F_paeth: stbi__unfilter_paeth_sse2(cur, prior, raw, n, bpp); return 1;
+   }
+   return 0;
+}
+#endif // STBI_SSE2
+
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
@@ -4014,10 +4509,22 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    int output_bytes = out_n*bytes;
    int filter_bytes = img_n*bytes;
    int width = x;
+   // a whole image that gains no channel unfilters in place, each row landing just before its
+   // own filtered bytes (which are always read before anything is written over them), and the
+   // inflated buffer becomes the image instead of needing a second one as big
+   int in_place = raw == a->expanded && s->img_x == x && s->img_y == y && img_n == out_n && depth >= 8;
+#ifdef STBI_SSE2
+   int simd = depth == 8 && img_n == out_n && (img_n == 3 || img_n == 4) && stbi__sse2_available();
+#endif
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
-   a->out = (stbi_uc *) stbi__malloc(x * y * output_bytes); // extra bytes to write off the end into
-   if (!a->out) return stbi__err("outofmem", "Out of memory");
+   if (in_place) {
+      a->out = raw;
+      a->expanded = NULL;
+   } else {
+      a->out = (stbi_uc *) stbi__malloc(x * y * output_bytes); // extra bytes to write off the end into
+      if (!a->out) return stbi__err("outofmem", "Out of memory");
+   }
 
    img_width_bytes = (((img_n * x * depth) + 7) >> 3);
    img_len = (img_width_bytes + 1) * y;
@@ -4081,12 +4588,18 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // this is a little gross, so that we don't switch per-pixel or per-component
       if (depth < 8 || img_n == out_n) {
          int nk = (width - 1)*filter_bytes;
+         #ifdef STBI_SSE2
+         if (simd && stbi__unfilter_row_sse2(filter, cur, prior, raw, nk, filter_bytes)) {
+            raw += nk;
+            continue;
+         }
+         #endif
          #define CASE(f) \
              case f:     \
                 for (k=0; k < nk; ++k)
          switch (filter) {
-            // "none" filter turns into a memcpy here; make that explicit.
-            case STBI__F_none:         memcpy(cur, raw, nk); break;
+            // "none" filter turns into a memmove here (the rows overlap when unfiltering in place); make that explicit.
+            case STBI__F_none:         memmove(cur, raw, nk); break;
             CASE(STBI__F_sub)          cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]); break;
             CASE(STBI__F_up)           cur[k] = STBI__BYTECAST(raw[k] + prior[k]); break;
             CASE(STBI__F_avg)          cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1)); break;
@@ -4233,7 +4746,7 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
       if (x && y) {
          stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
          if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
-            STBI_FREE(final);
+            stbi__free(final);
             return 0;
          }
          for (j=0; j < y; ++j) {
@@ -4244,7 +4757,7 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
                       a->out + (j*x+i)*out_n, out_n);
             }
          }
-         STBI_FREE(a->out);
+         stbi__free(a->out);
          image_data += img_len;
          image_data_len -= img_len;
       }
@@ -4333,7 +4846,7 @@ static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int
          p += 4;
       }
    }
-   STBI_FREE(a->out);
+   stbi__free(a->out);
    a->out = temp_out;
 
    STBI_NOTUSED(len);
@@ -4356,22 +4869,19 @@ static int stbi__reduce_png(stbi__png *p)
    for (i = 0; i < img_len; ++i) reduced[i] = (stbi_uc)((orig[i] >> 8) & 0xFF); // top half of each byte is a decent approx of 16->8 bit scaling
 
    p->out = reduced;
-   STBI_FREE(orig);
+   stbi__free(orig);
 
    return 1;
 }
 
-static int stbi__unpremultiply_on_load = 0;
-static int stbi__de_iphone_flag = 0;
-
 STBIDEF void stbi_set_unpremultiply_on_load(int flag_true_if_should_unpremultiply)
 {
-   stbi__unpremultiply_on_load = flag_true_if_should_unpremultiply;
+   stbi__default_options.unpremultiply = flag_true_if_should_unpremultiply;
 }
 
 STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert)
 {
-   stbi__de_iphone_flag = flag_true_if_should_convert;
+   stbi__default_options.convert_iphone_png = flag_true_if_should_convert;
 }
 
 static void stbi__de_iphone(stbi__png *z)
@@ -4389,7 +4899,7 @@ static void stbi__de_iphone(stbi__png *z)
       }
    } else {
       STBI_ASSERT(s->img_out_n == 4);
-      if (stbi__unpremultiply_on_load) {
+      if (stbi__options()->unpremultiply) {
          // convert bgr to rgb and unpremultiply
          for (i=0; i < pixel_count; ++i) {
             stbi_uc a = p[3];
@@ -4418,12 +4928,33 @@ static void stbi__de_iphone(stbi__png *z)
 
 #define STBI__PNG_TYPE(a,b,c,d)  (((a) << 24) + ((b) << 16) + ((c) << 8) + (d))
 
+// Exact size of the inflated IDAT data: a filter byte and the packed pixels for every row,
+// of all seven passes if it's interlaced
+static stbi__uint32 stbi__png_raw_size(stbi__context *s, int depth, int interlaced)
+{
+   static const int xorig[] = { 0,4,0,2,0,1,0 };
+   static const int yorig[] = { 0,0,4,0,2,0,1 };
+   static const int xspc[]  = { 8,8,4,4,2,2,1 };
+   static const int yspc[]  = { 8,8,8,4,4,2,2 };
+   stbi__uint32 size = 0, x, y;
+   int p;
+   if (!interlaced)
+      return (((s->img_n * s->img_x * depth) + 7) >> 3) * s->img_y + s->img_y;
+   for (p=0; p < 7; ++p) {
+      x = (s->img_x - xorig[p] + xspc[p]-1) / xspc[p];
+      y = (s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
+      if (x && y)
+         size += ((((s->img_n * x * depth) + 7) >> 3) + 1) * y;
+   }
+   return size;
+}
+
 static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 {
    stbi_uc palette[1024], pal_img_n=0;
    stbi_uc has_trans=0, tc[3];
    stbi__uint16 tc16[3];
-   stbi__uint32 ioff=0, idata_limit=0, i, pal_len=0;
+   stbi__uint32 ioff=0, idata_limit=0, i, pal_len=0, raw_len=0;
    int first=1,k,interlace=0, color=0, is_iphone=0;
    stbi__context *s = z->s;
 
@@ -4516,11 +5047,20 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             if (ioff + c.length > idata_limit) {
                stbi__uint32 idata_limit_old = idata_limit;
                stbi_uc *p;
-               if (idata_limit == 0) idata_limit = c.length > 4096 ? c.length : 4096;
+               if (idata_limit == 0) {
+                  // room for all of it up front unless it compresses worse than stored blocks
+                  // (5 bytes a block, plus the zlib header and checksum), or than the rest of
+                  // an in-memory file could hold
+                  raw_len = stbi__png_raw_size(s, z->depth, interlace);
+                  idata_limit = raw_len + raw_len / 65535 * 5 + 16;
+                  if (!s->read_from_callbacks && idata_limit > (stbi__uint32) (s->img_buffer_end - s->img_buffer))
+                     idata_limit = (stbi__uint32) (s->img_buffer_end - s->img_buffer);
+                  if (idata_limit < c.length) idata_limit = c.length;
+               }
                while (ioff + c.length > idata_limit)
                   idata_limit *= 2;
                STBI_NOTUSED(idata_limit_old);
-               p = (stbi_uc *) STBI_REALLOC_SIZED(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
+               p = (stbi_uc *) stbi__realloc_sized(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
                z->idata = p;
             }
             if (!stbi__getn(s, z->idata+ioff,c.length)) return stbi__err("outofdata","Corrupt PNG");
@@ -4529,16 +5069,23 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
          }
 
          case STBI__PNG_TYPE('I','E','N','D'): {
-            stbi__uint32 raw_len, bpl;
+            stbi__zbuf zbuf;
+            int inflated;
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (scan != STBI__SCAN_load) return 1;
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
-            // initial guess for decoded data size to avoid unnecessary reallocs
-            bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
-            raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
-            z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
-            if (z->expanded == NULL) return 0; // zlib should set error
-            STBI_FREE(z->idata); z->idata = NULL;
+            // inflate into a buffer of exactly the size IHDR says, which a sound image never
+            // grows. Interlaced ones have always been let off with data past the last pass, so
+            // they can still grow it.
+            z->expanded = (stbi_uc *) stbi__malloc(raw_len);
+            if (z->expanded == NULL) return stbi__err("outofmem", "Out of memory");
+            zbuf.zbuffer = z->idata;
+            zbuf.zbuffer_end = z->idata + ioff;
+            inflated = stbi__do_zlib(&zbuf, (char *) z->expanded, raw_len, interlace, !is_iphone);
+            z->expanded = (stbi_uc *) zbuf.zout_start;
+            if (!inflated) return 0; // zlib should set error
+            raw_len = (stbi__uint32) (zbuf.zout - zbuf.zout_start);
+            stbi__free(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
                s->img_out_n = s->img_n+1;
             else
@@ -4551,7 +5098,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                   if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
                }
             }
-            if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
+            if (is_iphone && stbi__options()->convert_iphone_png && s->img_out_n > 2)
                stbi__de_iphone(z);
             if (pal_img_n) {
                // pal_img_n == 3 or 4
@@ -4561,7 +5108,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                if (!stbi__expand_png_palette(z, palette, pal_len, s->img_out_n))
                   return 0;
             }
-            STBI_FREE(z->expanded); z->expanded = NULL;
+            stbi__free(z->expanded); z->expanded = NULL;
             return 1;
          }
 
@@ -4570,8 +5117,8 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if ((c.type & (1 << 29)) == 0) {
                #ifndef STBI_NO_FAILURE_STRINGS
-               // not threadsafe
-               static char invalid_chunk[] = "XXXX PNG chunk not known";
+               // one per thread, it's the failure reason
+               static STBI_THREAD_LOCAL char invalid_chunk[] = "XXXX PNG chunk not known";
                invalid_chunk[0] = STBI__BYTECAST(c.type >> 24);
                invalid_chunk[1] = STBI__BYTECAST(c.type >> 16);
                invalid_chunk[2] = STBI__BYTECAST(c.type >>  8);
@@ -4608,9 +5155,9 @@ static unsigned char *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req
       *y = p->s->img_y;
       if (n) *n = p->s->img_n;
    }
-   STBI_FREE(p->out);      p->out      = NULL;
-   STBI_FREE(p->expanded); p->expanded = NULL;
-   STBI_FREE(p->idata);    p->idata    = NULL;
+   stbi__free(p->out);      p->out      = NULL;
+   stbi__free(p->expanded); p->expanded = NULL;
+   stbi__free(p->idata);    p->idata    = NULL;
 
    return result;
 }
@@ -4847,7 +5394,7 @@ static stbi_uc *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int
    if (!out) return stbi__errpuc("outofmem", "Out of memory");
    if (info.bpp < 16) {
       int z=0;
-      if (psize == 0 || psize > 256) { STBI_FREE(out); return stbi__errpuc("invalid", "Corrupt BMP"); }
+      if (psize == 0 || psize > 256) { stbi__free(out); return stbi__errpuc("invalid", "Corrupt BMP"); }
       for (i=0; i < psize; ++i) {
          pal[i][2] = stbi__get8(s);
          pal[i][1] = stbi__get8(s);
@@ -4858,7 +5405,7 @@ static stbi_uc *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int
       stbi__skip(s, info.offset - 14 - info.hsz - psize * (info.hsz == 12 ? 3 : 4));
       if (info.bpp == 4) width = (s->img_x + 1) >> 1;
       else if (info.bpp == 8) width = s->img_x;
-      else { STBI_FREE(out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
+      else { stbi__free(out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
       pad = (-width)&3;
       for (j=0; j < (int) s->img_y; ++j) {
          for (i=0; i < (int) s->img_x; i += 2) {
@@ -4896,7 +5443,7 @@ static stbi_uc *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int
             easy = 2;
       }
       if (!easy) {
-         if (!mr || !mg || !mb) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
+         if (!mr || !mg || !mb) { stbi__free(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
          // right shift amt to put high bit in position #7
          rshift = stbi__high_bit(mr)-7; rcount = stbi__bitcount(mr);
          gshift = stbi__high_bit(mg)-7; gcount = stbi__bitcount(mg);
@@ -5164,7 +5711,7 @@ static stbi_uc *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int
          //   load the palette
          tga_palette = (unsigned char*)stbi__malloc( tga_palette_len * tga_comp );
          if (!tga_palette) {
-            STBI_FREE(tga_data);
+            stbi__free(tga_data);
             return stbi__errpuc("outofmem", "Out of memory");
          }
          if (tga_rgb16) {
@@ -5175,8 +5722,8 @@ static stbi_uc *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int
                pal_entry += tga_comp;
             }
          } else if (!stbi__getn(s, tga_palette, tga_palette_len * tga_comp)) {
-               STBI_FREE(tga_data);
-               STBI_FREE(tga_palette);
+               stbi__free(tga_data);
+               stbi__free(tga_palette);
                return stbi__errpuc("bad palette", "Corrupt TGA");
          }
       }
@@ -5257,7 +5804,7 @@ static stbi_uc *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int
       //   clear my palette, if I had one
       if ( tga_palette != NULL )
       {
-         STBI_FREE( tga_palette );
+         stbi__free( tga_palette );
       }
    }
 
@@ -5676,7 +6223,7 @@ static stbi_uc *stbi__pic_load(stbi__context *s,int *px,int *py,int *comp,int re
    memset(result, 0xff, x*y*4);
 
    if (!stbi__pic_load_core(s,x,y,comp, result)) {
-      STBI_FREE(result);
+      stbi__free(result);
       result=0;
    }
    *px = x;
@@ -5783,13 +6330,13 @@ static int stbi__gif_info_raw(stbi__context *s, int *x, int *y, int *comp)
 {
    stbi__gif* g = (stbi__gif*) stbi__malloc(sizeof(stbi__gif));
    if (!stbi__gif_header(s, g, comp, 1)) {
-      STBI_FREE(g);
+      stbi__free(g);
       stbi__rewind( s );
       return 0;
    }
    if (x) *x = g->w;
    if (y) *y = g->h;
-   STBI_FREE(g);
+   stbi__free(g);
    return 1;
 }
 
@@ -6054,8 +6601,8 @@ static stbi_uc *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp, int
          u = stbi__convert_format(u, 4, req_comp, g->w, g->h);
    }
    else if (g->out)
-      STBI_FREE(g->out);
-   STBI_FREE(g);
+      stbi__free(g->out);
+   stbi__free(g);
    return u;
 }
 
@@ -6213,12 +6760,12 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
             stbi__hdr_convert(hdr_data, rgbe, req_comp);
             i = 1;
             j = 0;
-            STBI_FREE(scanline);
+            stbi__free(scanline);
             goto main_decode_loop; // yes, this makes no sense
          }
          len <<= 8;
          len |= stbi__get8(s);
-         if (len != width) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
+         if (len != width) { stbi__free(hdr_data); stbi__free(scanline); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
          if (scanline == NULL) scanline = (stbi_uc *) stbi__malloc(width * 4);
 
          for (k = 0; k < 4; ++k) {
@@ -6241,7 +6788,7 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
          for (i=0; i < width; ++i)
             stbi__hdr_convert(hdr_data+(j*width + i)*req_comp, scanline + i*4, req_comp);
       }
-      STBI_FREE(scanline);
+      stbi__free(scanline);
    }
 
    return hdr_data;
@@ -0,0 +1,264 @@
+/**
+* Texture baker: turns PNGs into the game's baked texture format (see BakedTexture.h), so the
+* game can map them straight into memory at startup instead of inflating and unfiltering PNGs
+* that never change.
+*
+* Usage: texture_baker [--mip-levels N] [--premultiply] [--bc3] input.png...
+*        texture_baker --decode-bench N input.png...
+*
+* Writes input.tex next to each input. Every mip level is built here, down to 1x1 unless
+* --mip-levels stops it sooner, so the game doesn't have to generate any at load time.
+* --premultiply stores colour multiplied by alpha, and the game blends with GL_ONE to match.
+* --bc3 block compresses every level to a quarter of the size, see BlockCompression.h.
+*
+* --decode-bench decodes each input N times instead and reports how fast stb_image got through
+* them, for checking changes to the decoder. Build with STBI_NO_SIMD to compare against scalar.
+**/
+
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "BakedTexture.h"
+#include "BlockCompression.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define LOG(argument) std::cout << argument << '\n'
+
+struct Level
+{
+    int width = 0, height = 0;
+    std::vector<uint8_t> pixels;  // RGBA
+};
+
+// Next level down, each pixel the alpha weighted average of a 2x2 block so transparent
+// pixels don't darken the edges. Odd sizes round down like GL's own levels do.
+Level half_level(const Level& level)
+{
+    Level half;
+    half.width = std::max(level.width / 2, 1);
+    half.height = std::max(level.height / 2, 1);
+    half.pixels.resize((size_t)half.width * half.height * 4);
+
+    for (int y = 0; y < half.height; y++)
+    {
+        for (int x = 0; x < half.width; x++)
+        {
+            double red = 0.0, green = 0.0, blue = 0.0, alpha = 0.0;
+            for (int sy = 0; sy < 2; sy++)
+            {
+                for (int sx = 0; sx < 2; sx++)
+                {
+                    int source_x = std::min(x * 2 + sx, level.width - 1), source_y = std::min(y * 2 + sy, level.height - 1);
+                    const uint8_t* pixel = &level.pixels[((size_t)source_y * level.width + source_x) * 4];
+                    double a = pixel[3];
+                    red += pixel[0] * a;
+                    green += pixel[1] * a;
+                    blue += pixel[2] * a;
+                    alpha += a;
+                }
+            }
+
+            uint8_t* out = &half.pixels[((size_t)y * half.width + x) * 4];
+            if (alpha > 0.0)
+            {
+                out[0] = (uint8_t)std::lround(red / alpha);
+                out[1] = (uint8_t)std::lround(green / alpha);
+                out[2] = (uint8_t)std::lround(blue / alpha);
+            }
+            else
+            {
+                // all four are invisible, keep their colour so the next level down still has some
+                const uint8_t* pixel = &level.pixels[((size_t)std::min(y * 2, level.height - 1) * level.width + std::min(x * 2, level.width - 1)) * 4];
+                out[0] = pixel[0];
+                out[1] = pixel[1];
+                out[2] = pixel[2];
+            }
+            out[3] = (uint8_t)std::lround(alpha / 4.0);
+        }
+    }
+    return half;
+}
+
+void premultiply(Level& level)
+{
+    for (size_t i = 0; i < level.pixels.size(); i += 4)
+    {
+        for (int c = 0; c < 3; c++) level.pixels[i + c] = (uint8_t)((level.pixels[i + c] * level.pixels[i + 3] + 127) / 255);
+    }
+}
+
+size_t align(size_t offset)
+{
+    return (offset + BAKED_ALIGNMENT - 1) / BAKED_ALIGNMENT * BAKED_ALIGNMENT;
+}
+
+bool bake(const char* path, int max_levels, bool premultiplied, bool bc3)
+{
+    // read it ourselves rather than through stbi_load, the header keeps a hash of the exact bytes
+    std::vector<uint8_t> source;
+    FILE* source_file = fopen(path, "rb");
+    if (source_file != NULL)
+    {
+        uint8_t buffer[64 * 1024];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), source_file)) > 0) source.insert(source.end(), buffer, buffer + read);
+        fclose(source_file);
+    }
+
+    Level base;
+    int components;
+    unsigned char* image = source.empty() ? NULL : stbi_load_from_memory(source.data(), (int)source.size(), &base.width, &base.height, &components, STBI_rgb_alpha);
+    if (image == NULL)
+    {
+        LOG("Unable to load " << path << ": " << (source.empty() ? "can't read it" : stbi_failure_reason()));
+        return false;
+    }
+    base.pixels.assign(image, image + (size_t)base.width * base.height * 4);
+    stbi_image_free(image);
+
+    // straight alpha all the way down, premultiplying only at the end so the averages stay right
+    std::vector<Level> levels;
+    levels.push_back(std::move(base));
+    while ((int)levels.size() <= max_levels && levels.size() < BAKED_MAX_LEVELS && (levels.back().width > 1 || levels.back().height > 1))
+    {
+        levels.push_back(half_level(levels.back()));
+    }
+    if (premultiplied)
+    {
+        for (Level& level : levels) premultiply(level);
+    }
+
+    size_t uncompressed = 0;
+    double compress_milliseconds = 0.0;
+    for (const Level& level : levels) uncompressed += level.pixels.size();
+    if (bc3)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (Level& level : levels)
+        {
+            std::vector<uint8_t> blocks(bc3_size(level.width, level.height));
+            compress_bc3(level.pixels.data(), level.width, level.height, blocks.data());
+            level.pixels.swap(blocks);
+        }
+        compress_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    BakedHeader header = {};
+    memcpy(header.magic, BAKED_MAGIC, sizeof(BAKED_MAGIC));
+    header.version = BAKED_VERSION;
+    header.format = (bc3 ? BAKED_BC3 : BAKED_RGBA8) | (premultiplied ? 1 : 0);
+    header.level_count = (uint32_t)levels.size();
+    header.source_size = source.size();
+    header.source_hash = baked_source_hash(source.data(), source.size());
+    size_t offset = align(sizeof(BakedHeader));
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        header.levels[i].width = levels[i].width;
+        header.levels[i].height = levels[i].height;
+        header.levels[i].offset = offset;
+        header.levels[i].size = levels[i].pixels.size();
+        offset = align(offset + levels[i].pixels.size());
+    }
+
+    std::string output = path;
+    size_t dot = output.find_last_of('.');
+    if (dot != std::string::npos && output.find_first_of("/\\", dot) == std::string::npos) output.erase(dot);
+    output += ".tex";
+
+    FILE* file = fopen(output.c_str(), "wb");
+    if (file == NULL)
+    {
+        LOG("Unable to write " << output);
+        return false;
+    }
+    std::vector<uint8_t> contents(offset, 0);
+    memcpy(contents.data(), &header, sizeof(header));
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        memcpy(&contents[header.levels[i].offset], levels[i].pixels.data(), levels[i].pixels.size());
+    }
+    bool written = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    written = fclose(file) == 0 && written;
+    if (!written)
+    {
+        LOG("Unable to write " << output);
+        return false;
+    }
+
+    LOG("baked " << output << ": " << levels[0].width << "x" << levels[0].height << ", " << levels.size()
+        << " levels, " << contents.size() / 1024 << " KiB" << (premultiplied ? ", premultiplied" : ""));
+    if (bc3)
+    {
+        LOG("  BC3 " << (uncompressed - (contents.size() - header.levels[0].offset)) / 1024 << " KiB smaller than RGBA8, compressed in "
+            << compress_milliseconds << " ms");
+    }
+    return true;
+}
+
+// Decoded megabytes of RGBA per second, over every input
+bool decode_bench(const std::vector<const char*>& paths, int repeats)
+{
+    double total_megabytes = 0.0, total_seconds = 0.0;
+    for (const char* path : paths)
+    {
+        double megabytes = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeats; i++)
+        {
+            int width, height, components;
+            unsigned char* image = stbi_load(path, &width, &height, &components, STBI_rgb_alpha);
+            if (image == NULL)
+            {
+                LOG("Unable to load " << path << ": " << stbi_failure_reason());
+                return false;
+            }
+            megabytes += width * (double)height * 4 / 1e6;
+            stbi_image_free(image);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        LOG(path << ": " << megabytes / seconds << " MB/s");
+        total_megabytes += megabytes;
+        total_seconds += seconds;
+    }
+    LOG("all: " << total_megabytes / total_seconds << " MB/s");
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int mip_levels = BAKED_MAX_LEVELS - 1;
+    bool premultiplied = false;
+    bool bc3 = false;
+    int bench_repeats = 0;
+    std::vector<const char*> paths;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--mip-levels") == 0 && i + 1 < argc) mip_levels = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--premultiply") == 0) premultiplied = true;
+        else if (strcmp(argv[i], "--bc3") == 0) bc3 = true;
+        else if (strcmp(argv[i], "--decode-bench") == 0 && i + 1 < argc) bench_repeats = atoi(argv[++i]);
+        else paths.push_back(argv[i]);
+    }
+    if (paths.empty() || mip_levels < 0)
+    {
+        LOG("Usage: texture_baker [--mip-levels N] [--premultiply] [--bc3] input.png...");
+        LOG("       texture_baker --decode-bench N input.png...");
+        return 1;
+    }
+    if (bench_repeats > 0) return decode_bench(paths, bench_repeats) ? 0 : 1;
+
+    for (const char* path : paths)
+    {
+        if (!bake(path, mip_levels, premultiplied, bc3)) return 1;
+    }
+    return 0;
+}